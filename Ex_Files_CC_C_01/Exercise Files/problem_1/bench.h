@@ -0,0 +1,52 @@
+/*
+	bench
+	Microbenchmarks for the hot paths of fetch_data and crunch_data.
+	bench_data.c builds the synthetic inputs and times each benchmark;
+	bench_fetch.c and bench_crunch.c compile the two programs (with
+	their main() renamed) so the benchmarks call the real functions.
+	bench_live.c is a stress test of live_series.h, with threads.
+
+	Every benchmark returns the seconds taken by one pass over the
+	corpus, not counting its own setup.
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+
+#define BENCH_CHANNELS 3
+
+/* one scale's worth of synthetic input, in every form the tools see */
+struct corpus {
+	const char *scale;		/* "1d", "1y", ... */
+	long days;
+	long rows;
+	char *page[BENCH_CHANNELS];	/* channel pages, as the site serves them */
+	size_t page_size[BENCH_CHANNELS];
+	char *table;			/* fetch_data output, crunch_data input */
+	size_t table_size;
+	float *column[BENCH_CHANNELS];	/* the values, as crunch_data stores them */
+};
+
+double bench_now(void);
+
+/* bench_fetch.c */
+void bench_make_table(struct corpus *c);
+double bench_write_line(struct corpus *c);
+double bench_merge(struct corpus *c);
+double bench_write_mem(struct corpus *c);
+
+/* bench_crunch.c */
+double bench_read_row(struct corpus *c);
+double bench_process_row(struct corpus *c);
+double bench_get_mean(struct corpus *c);
+double bench_get_median(struct corpus *c);
+double bench_get_weighted_median(struct corpus *c);
+double bench_output_plain(struct corpus *c);
+double bench_output_json(struct corpus *c);
+
+/* bench_live.c */
+void bench_live(struct corpus *c, int readers, int last);
+
+#endif
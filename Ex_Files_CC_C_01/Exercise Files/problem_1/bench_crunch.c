@@ -0,0 +1,209 @@
+/*
+	bench_crunch
+	crunch_data's hot paths, see bench.h
+*/
+
+#define main crunch_data_main
+#include "crunch_data.c"
+#undef main
+#include "bench.h"
+
+static void copy_readings(struct corpus *c, struct readings *data);
+static void free_readings(struct readings *data);
+static double bench_output(struct corpus *c, int json);
+
+/*
+	Read the table and split it into rows, a block at a time, as from
+	standard input
+*/
+double bench_read_row(struct corpus *c)
+{
+	struct input in;
+	FILE *fp;
+	double start,elapsed;
+
+	/* a real file, as the input is read with read() */
+	fp = tmpfile();
+	fwrite(c->table,1,c->table_size,fp);
+	fflush(fp);
+	rewind(fp);
+	open_input(&in,fileno(fp));
+	start = bench_now();
+	for(;;)
+	{
+		if(split_rows(&in) > 0)
+			continue;
+		if(in.eof)
+			break;
+		read_block(&in);
+	}
+	elapsed = bench_now() - start;
+	free(in.buffer);
+	fclose(fp);
+	return(elapsed);
+}
+
+/*
+	Convert every row's values with process_row(), i.e. strtof()
+*/
+double bench_process_row(struct corpus *c)
+{
+	struct readings data;
+	char *row,*next;
+	double start,elapsed;
+	int n;
+
+	memset(&data,0,sizeof(data));
+	while(data.capacity < c->rows)
+		grow_readings(&data);
+	start = bench_now();
+	n = 0;
+	for(row=c->table;row<c->table+c->table_size;row=next+1)
+	{
+		next = memchr(row,'\n',c->table+c->table_size-row);
+		process_row(n++,row,data.column[0],data.column[1],data.column[2]);
+	}
+	elapsed = bench_now() - start;
+	free_readings(&data);
+	return(elapsed);
+}
+
+double bench_get_mean(struct corpus *c)
+{
+	volatile float sink;
+	double start,elapsed;
+	int x;
+
+	start = bench_now();
+	for(x=0;x<COLUMNS;x++)
+		sink = get_mean(c->column[x],c->rows);
+	elapsed = bench_now() - start;
+	(void)sink;
+	return(elapsed);
+}
+
+/*
+	The median by quickselect; the column is copied first, outside the
+	timing, as the selection reorders it
+*/
+double bench_get_median(struct corpus *c)
+{
+	struct readings data;
+	volatile float sink;
+	double start,elapsed;
+	int x;
+
+	copy_readings(c,&data);
+	start = bench_now();
+	for(x=0;x<COLUMNS;x++)
+		sink = get_median(data.column[x],data.count);
+	elapsed = bench_now() - start;
+	(void)sink;
+	free_readings(&data);
+	return(elapsed);
+}
+
+/*
+	The time-weighted median of each column, with the corpus' rows
+	weighted unevenly, 30 to 90 seconds apiece, as the weighted
+	selection would otherwise see equal weights; the columns and
+	weights are copied first, outside the timing
+*/
+double bench_get_weighted_median(struct corpus *c)
+{
+	struct readings data;
+	float *weight[COLUMNS];
+	volatile float sink;
+	double start,elapsed;
+	long r;
+	int x;
+
+	copy_readings(c,&data);
+	for(x=0;x<COLUMNS;x++)
+	{
+		weight[x] = malloc(c->rows*sizeof(float));
+		if(weight[x] == NULL)
+		{
+			fprintf(stderr,"bench_data: Unable to allocate the weights.\n");
+			exit(1);
+		}
+		for(r=0;r<c->rows;r++)
+			weight[x][r] = 30 + (r * 7919) % 61;
+	}
+	start = bench_now();
+	for(x=0;x<COLUMNS;x++)
+		sink = weighted_median(data.column[x],weight[x],data.count);
+	elapsed = bench_now() - start;
+	(void)sink;
+	for(x=0;x<COLUMNS;x++)
+		free(weight[x]);
+	free_readings(&data);
+	return(elapsed);
+}
+
+double bench_output_plain(struct corpus *c)
+{
+	return(bench_output(c,0));
+}
+
+double bench_output_json(struct corpus *c)
+{
+	return(bench_output(c,1));
+}
+
+/*
+	The day's report written to /dev/null: the means and medians, with
+	the trimmed mean and MAD, which sort the columns again. The
+	sections built up while rows are stored (histograms, correlation,
+	top and bottom, trend, events) are left out, as the corpus has no
+	times to build them from.
+*/
+static double bench_output(struct corpus *c, int json)
+{
+	struct readings data;
+	struct options opt;
+	FILE *fp;
+	double start,elapsed;
+
+	memset(&opt,0,sizeof(opt));
+	opt.json_output = json;
+	opt.trim = 10;
+	opt.mad = 1;
+	copy_readings(c,&data);
+	fp = fopen("/dev/null","w");
+	if(fp == NULL)
+	{
+		fprintf(stderr,"bench_data: Unable to open /dev/null.\n");
+		exit(1);
+	}
+	start = bench_now();
+	if(json)
+		output_json(fp,"2015-01-01",&data,&opt,NULL);
+	else
+		output_plain(fp,"2015-01-01",&data,&opt,NULL);
+	fflush(fp);
+	elapsed = bench_now() - start;
+	fclose(fp);
+	free_readings(&data);
+	return(elapsed);
+}
+
+static void copy_readings(struct corpus *c, struct readings *data)
+{
+	int x;
+
+	memset(data,0,sizeof(*data));
+	while(data->capacity < c->rows)
+		grow_readings(data);
+	for(x=0;x<COLUMNS;x++)
+		memcpy(data->column[x],c->column[x],c->rows*sizeof(float));
+	data->count = c->rows;
+}
+
+static void free_readings(struct readings *data)
+{
+	int x;
+
+	for(x=0;x<COLUMNS;x++)
+		free(data->column[x]);
+}
@@ -0,0 +1,231 @@
+/*
+	bench_data
+	Times the hot paths of fetch_data and crunch_data (see bench.h) over
+	synthetic data from one day up to ten years, one row a minute, and
+	reports the results as JSON on standard output:
+
+	{ "benchmarks": [
+	  { "name": "merge", "scale": "1d", "rows": 1440, "bytes": 40320,
+	    "iterations": 91, "ns_per_row": 51.2, "rows_per_s": 19531250,
+	    "bytes_per_s": 546875000 },
+	  ...
+	] }
+
+	`bytes` is the input each benchmark goes through: the pages for
+	fetch_data's paths, the table for crunch_data's parsing and the
+	float columns for its statistics. Short benchmarks are repeated
+	until they have run for BENCH_MIN_SECONDS.
+
+	Each scale ends with the live_series stress test (see bench_live.c):
+	the writer's rows per second with and without READERS threads
+	querying the rows as they're added, 4 unless --readers is given,
+	and the latency of their queries.
+
+	Build and run with `make bench`; `make bench BENCH_ARGS="--max-scale 1y"`
+	stops at a year.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "bench.h"
+#include "timestamp.h"
+
+#define BENCH_MIN_SECONDS 0.25
+#define ROWS_PER_DAY 1440
+#define PAGE_LINE 28			/* "YYYY_MM_DD HH:MM:SS  30.12\r\n" */
+#define READERS 4				/* live_series readers */
+#define MAX_READERS 64
+
+struct scale {
+	const char *name;
+	long days;
+};
+
+struct benchmark {
+	const char *name;
+	double (*run)(struct corpus *c);
+	int input;				/* what `bytes` counts, below */
+};
+
+enum {
+	INPUT_PAGES,
+	INPUT_TABLE,
+	INPUT_COLUMNS
+};
+
+static const struct scale scales[] = {
+	{ "1d", 1 }, { "30d", 30 }, { "1y", 365 }, { "10y", 3652 }
+};
+static const struct benchmark benchmarks[] = {
+	{ "write_line", bench_write_line, INPUT_PAGES },
+	{ "merge", bench_merge, INPUT_PAGES },
+	{ "write_mem", bench_write_mem, INPUT_PAGES },
+	{ "read_row", bench_read_row, INPUT_TABLE },
+	{ "process_row", bench_process_row, INPUT_TABLE },
+	{ "get_mean", bench_get_mean, INPUT_COLUMNS },
+	{ "get_median", bench_get_median, INPUT_COLUMNS },
+	{ "get_weighted_median", bench_get_weighted_median, INPUT_COLUMNS },
+	{ "output_plain", bench_output_plain, INPUT_COLUMNS },
+	{ "output_json", bench_output_json, INPUT_COLUMNS }
+};
+
+void make_corpus(struct corpus *c, const struct scale *s);
+void free_corpus(struct corpus *c);
+void report(const struct benchmark *b, struct corpus *c, int iterations, double seconds, int last);
+
+int main(int argc, char *argv[])
+{
+	struct corpus c;
+	double seconds;
+	int a,s,b,scale_count,iterations,readers;
+	char *end;
+
+	readers = READERS;
+	scale_count = sizeof(scales)/sizeof(scales[0]);
+	for(a=1;a<argc;a++)
+	{
+		if(strcmp(argv[a],"--max-scale") == 0 && a+1 < argc)
+		{
+			a++;
+			for(s=0;s<scale_count;s++)
+				if(strcmp(argv[a],scales[s].name) == 0)
+					break;
+			if(s == scale_count)
+			{
+				fprintf(stderr,"bench_data: Unknown scale, use 1d, 30d, 1y or 10y\n");
+				return(1);
+			}
+			scale_count = s+1;
+		}
+		else if(strcmp(argv[a],"--readers") == 0 && a+1 < argc)
+		{
+			readers = (int)strtol(argv[++a],&end,10);
+			if(*end != '\0' || readers < 1 || readers > MAX_READERS)
+			{
+				fprintf(stderr,"bench_data: Readers must be from 1 to %d\n",MAX_READERS);
+				return(1);
+			}
+		}
+		else
+		{
+			puts("bench_data [--max-scale 1d|30d|1y|10y] [--readers N]");
+			return(1);
+		}
+	}
+
+	printf("{ \"benchmarks\": [\n");
+	for(s=0;s<scale_count;s++)
+	{
+		make_corpus(&c,&scales[s]);
+		for(b=0;b<(int)(sizeof(benchmarks)/sizeof(benchmarks[0]));b++)
+		{
+			seconds = 0;
+			iterations = 0;
+			while(iterations == 0 || seconds < BENCH_MIN_SECONDS)
+			{
+				seconds += benchmarks[b].run(&c);
+				iterations++;
+			}
+			report(&benchmarks[b],&c,iterations,seconds,0);
+		}
+		bench_live(&c,readers,s == scale_count-1);
+		free_corpus(&c);
+	}
+	printf("] }\n");
+
+	return(0);
+}
+
+/*
+	Build the pages a row a minute from 2015_01_01, values following a
+	daily cycle plus noise, then the table fetch_data would make of them
+*/
+void make_corpus(struct corpus *c, const struct scale *s)
+{
+	char stamp[TIMESTAMP_SIZE];
+	unsigned long seed;
+	long r,t,start;
+	float value[BENCH_CHANNELS],noise;
+	char *line;
+	int x;
+
+	memset(c,0,sizeof(*c));
+	c->scale = s->name;
+	c->days = s->days;
+	c->rows = s->days * ROWS_PER_DAY;
+	for(x=0;x<BENCH_CHANNELS;x++)
+	{
+		c->page_size[x] = c->rows * PAGE_LINE;
+		c->page[x] = malloc(c->page_size[x]+1);
+		c->column[x] = malloc(c->rows*sizeof(float));
+		if(c->page[x] == NULL || c->column[x] == NULL)
+		{
+			fprintf(stderr,"bench_data: Unable to allocate %s of data.\n",s->name);
+			exit(1);
+		}
+	}
+
+	seed = 20150203;
+	start = parse_timestamp("2015_01_01 00:00:00");
+	for(r=0;r<c->rows;r++)
+	{
+		t = start + r*60 + 25;
+		format_timestamp(t,stamp);
+		seed = seed*6364136223846793005UL + 1442695040888963407UL;
+		noise = (float)((seed >> 40) & 0xffff) / 65536.0f - 0.5f;
+		value[0] = 8.0f + 10.0f*sinf((float)(t % TIMESTAMP_DAY) * 7.27e-5f) + 2.0f*noise;
+		value[1] = 30.0f + 0.4f*sinf((float)r * 1.0e-3f) + 0.05f*noise;
+		value[2] = 4.0f + 3.0f*noise;
+		for(x=0;x<BENCH_CHANNELS;x++)
+		{
+			line = c->page[x] + r*PAGE_LINE;
+			snprintf(line,PAGE_LINE+1,"%s %6.2f\r\n",stamp,value[x]);
+			c->column[x][r] = value[x];
+		}
+	}
+	bench_make_table(c);
+}
+
+void free_corpus(struct corpus *c)
+{
+	int x;
+
+	for(x=0;x<BENCH_CHANNELS;x++)
+	{
+		free(c->page[x]);
+		free(c->column[x]);
+	}
+	free(c->table);
+}
+
+void report(const struct benchmark *b, struct corpus *c, int iterations, double seconds, int last)
+{
+	double bytes,per_pass;
+	int x;
+
+	bytes = 0;
+	if(b->input == INPUT_PAGES)
+		for(x=0;x<BENCH_CHANNELS;x++)
+			bytes += c->page_size[x];
+	else if(b->input == INPUT_TABLE)
+		bytes = c->table_size;
+	else
+		bytes = (double)c->rows * BENCH_CHANNELS * sizeof(float);
+
+	per_pass = seconds / iterations;
+	printf("  { \"name\": \"%s\", \"scale\": \"%s\", \"rows\": %ld, \"bytes\": %.0f, ",
+			b->name,c->scale,c->rows,bytes);
+	printf("\"iterations\": %d, \"ns_per_row\": %.2f, \"rows_per_s\": %.0f, \"bytes_per_s\": %.0f }%s\n",
+			iterations,per_pass*1e9/c->rows,c->rows/per_pass,bytes/per_pass,last ? "" : ",");
+}
+
+double bench_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return(now.tv_sec + now.tv_nsec/1e9);
+}
@@ -0,0 +1,125 @@
+/*
+	bench_fetch
+	fetch_data's hot paths, see bench.h
+*/
+
+#define main fetch_data_main
+#include "fetch_data.c"
+#undef main
+#include "bench.h"
+
+#define CURL_CHUNK 16384		/* what curl typically hands write_mem() */
+
+/*
+	Produce the merged table from the pages, as fetch_data would write
+	it, to serve as crunch_data's input
+*/
+void bench_make_table(struct corpus *c)
+{
+	struct page pages[BENCH_CHANNELS];
+	struct table_output out;
+	struct resample_options ro;
+	int x;
+
+	memset(pages,0,sizeof(pages));
+	memset(&out,0,sizeof(out));
+	memset(&ro,0,sizeof(ro));
+	for(x=0;x<BENCH_CHANNELS;x++)
+	{
+		pages[x].data.buffer = c->page[x];
+		pages[x].data.size = c->page_size[x];
+	}
+	out.fp = open_memstream(&c->table,&c->table_size);
+	out.channels = BENCH_CHANNELS;
+	out.end = -1;
+	write_station(pages,&out,&ro);
+	fclose(out.fp);
+}
+
+/*
+	Copy every line of every page out with write_line(), as the merge
+	loop does, but page by page
+*/
+double bench_write_line(struct corpus *c)
+{
+	FILE *fp;
+	double start,elapsed;
+	size_t offset;
+	int x;
+
+	fp = fopen("/dev/null","w");
+	start = bench_now();
+	for(x=0;x<BENCH_CHANNELS;x++)
+		for(offset=0;offset<c->page_size[x];)
+			offset += write_line(c->page[x]+offset,x ? VALUE_READ_OFFSET : 0,fp);
+	fflush(fp);
+	elapsed = bench_now() - start;
+	fclose(fp);
+	return(elapsed);
+}
+
+/*
+	The loop that merges the three pages into one table
+*/
+double bench_merge(struct corpus *c)
+{
+	struct page pages[BENCH_CHANNELS];
+	struct table_output out;
+	struct resample_options ro;
+	double start,elapsed;
+	int x;
+
+	memset(pages,0,sizeof(pages));
+	memset(&out,0,sizeof(out));
+	memset(&ro,0,sizeof(ro));
+	for(x=0;x<BENCH_CHANNELS;x++)
+	{
+		pages[x].data.buffer = c->page[x];
+		pages[x].data.size = c->page_size[x];
+	}
+	out.fp = fopen("/dev/null","w");
+	out.channels = BENCH_CHANNELS;
+	out.end = -1;
+	start = bench_now();
+	write_station(pages,&out,&ro);
+	fflush(out.fp);
+	elapsed = bench_now() - start;
+	fclose(out.fp);
+	return(elapsed);
+}
+
+/*
+	Receive the pages in curl-sized chunks through write_mem(), starting
+	from an empty pool each pass so the buffers have to grow
+*/
+double bench_write_mem(struct corpus *c)
+{
+	struct buffer_pool pool;
+	struct transfer x;
+	double start,elapsed;
+	size_t offset,chunk;
+	int p;
+
+	elapsed = 0;
+	for(p=0;p<BENCH_CHANNELS;p++)
+	{
+		memset(&pool,0,sizeof(pool));
+		pthread_mutex_init(&pool.lock,NULL);
+		memset(&x,0,sizeof(x));
+		x.pool = &pool;
+		start = bench_now();
+		pool_get(&pool,&x.data);
+		for(offset=0;offset<c->page_size[p];offset+=chunk)
+		{
+			chunk = c->page_size[p] - offset;
+			if(chunk > CURL_CHUNK)
+				chunk = CURL_CHUNK;
+			write_mem(c->page[p]+offset,1,chunk,&x);
+		}
+		pool_put(&pool,&x.data);
+		elapsed += bench_now() - start;
+		pool_drain(&pool);
+		pthread_mutex_destroy(&pool.lock);
+	}
+	return(elapsed);
+}
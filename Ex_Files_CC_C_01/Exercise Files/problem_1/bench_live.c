@@ -0,0 +1,180 @@
+/*
+	bench_live
+	The stress test of live_series.h: one writer appends the corpus'
+	rows a batch at a time while reader threads query them as fast as
+	they can, each query averaging the last hour of every column in its
+	snapshot. It reports the writer's rows per second, alone and with
+	the readers going, and the readers' query latency percentiles. Each
+	query also checks that the newest row of its snapshot is the one
+	written, whole; a row seen otherwise counts as torn, which should
+	never happen.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "bench.h"
+#include "live_series.h"
+#include "hdr_hist.h"
+
+#define LIVE_BATCH 64				/* rows the writer publishes at a time */
+#define LIVE_WINDOW 3600			/* seconds each query averages */
+#define LIVE_STEP 60				/* seconds between the corpus' rows */
+
+struct live_reader {
+	pthread_t thread;
+	struct live_series *s;
+	struct corpus *c;
+	atomic_int *ready;				/* readers started */
+	atomic_int *done;				/* the writer has finished */
+	struct hdr_hist latency;		/* ns per query */
+	long torn;
+	double sink;
+};
+
+static double append_all(struct corpus *c, struct live_series *s);
+static void *read_live(void *arg);
+
+/*
+	Run the test over the corpus with `readers` reader threads and
+	report it as one of the benchmarks
+*/
+void bench_live(struct corpus *c, int readers, int last)
+{
+	struct live_series s;
+	struct live_reader *reader;
+	struct hdr_hist latency;
+	atomic_int ready,done;
+	double alone,shared;
+	long torn;
+	int x;
+
+	/* the writer on its own */
+	if(live_series_init(&s,BENCH_CHANNELS) != 0)
+	{
+		fprintf(stderr,"bench_data: Unable to allocate the live series.\n");
+		exit(1);
+	}
+	alone = append_all(c,&s);
+	live_series_free(&s);
+
+	/* and again with the readers going */
+	reader = (struct live_reader *)calloc(readers,sizeof(struct live_reader));
+	if(reader == NULL || live_series_init(&s,BENCH_CHANNELS) != 0)
+	{
+		fprintf(stderr,"bench_data: Unable to allocate the live series.\n");
+		exit(1);
+	}
+	atomic_init(&ready,0);
+	atomic_init(&done,0);
+	for(x=0;x<readers;x++)
+	{
+		reader[x].s = &s;
+		reader[x].c = c;
+		reader[x].ready = &ready;
+		reader[x].done = &done;
+		hdr_init(&reader[x].latency);
+		if(pthread_create(&reader[x].thread,NULL,read_live,&reader[x]) != 0)
+		{
+			fprintf(stderr,"bench_data: Unable to start reader %d.\n",x);
+			exit(1);
+		}
+	}
+	/* every reader querying before the first row goes in */
+	while(atomic_load(&ready) < readers)
+		sched_yield();
+	shared = append_all(c,&s);
+	atomic_store_explicit(&done,1,memory_order_release);
+	hdr_init(&latency);
+	torn = 0;
+	for(x=0;x<readers;x++)
+	{
+		pthread_join(reader[x].thread,NULL);
+		hdr_merge(&latency,&reader[x].latency);
+		torn += reader[x].torn;
+	}
+	live_series_free(&s);
+	free(reader);
+
+	printf("  { \"name\": \"live_series\", \"scale\": \"%s\", \"rows\": %ld, \"readers\": %d, ",
+			c->scale,c->rows,readers);
+	printf("\"append_rows_per_s_alone\": %.0f, \"append_rows_per_s\": %.0f, \"queries\": %ld, ",
+			c->rows/alone,c->rows/shared,latency.total);
+	printf("\"query_p50_us\": %.3f, \"query_p99_us\": %.3f, \"query_max_us\": %.3f, \"torn\": %ld }%s\n",
+			hdr_percentile(&latency,50)/1e3,hdr_percentile(&latency,99)/1e3,latency.max/1e3,
+			torn,last ? "" : ",");
+}
+
+/*
+	Append every row of the corpus, LIVE_BATCH at a time, gathering
+	each batch into rows as a parser would hand them over
+	Returns the seconds taken.
+*/
+static double append_all(struct corpus *c, struct live_series *s)
+{
+	long t[LIVE_BATCH];
+	float v[LIVE_BATCH*BENCH_CHANNELS];
+	double start;
+	long r;
+	int n,x,y;
+
+	start = bench_now();
+	for(r=0;r<c->rows;r+=n)
+	{
+		n = c->rows - r < LIVE_BATCH ? c->rows - r : LIVE_BATCH;
+		for(x=0;x<n;x++)
+		{
+			t[x] = (r + x) * LIVE_STEP;
+			for(y=0;y<BENCH_CHANNELS;y++)
+				v[x*BENCH_CHANNELS+y] = c->column[y][r+x];
+		}
+		if(live_series_append(s,t,v,n) != 0)
+		{
+			fprintf(stderr,"bench_data: Unable to append to the live series.\n");
+			exit(1);
+		}
+	}
+	return(bench_now() - start);
+}
+
+/*
+	Reader thread: query snapshots until the writer is done
+*/
+static void *read_live(void *arg)
+{
+	struct live_reader *reader;
+	struct live_series *s;
+	double start;
+	long length,newest,from;
+	int x;
+
+	reader = (struct live_reader *)arg;
+	s = reader->s;
+	atomic_fetch_add(reader->ready,1);
+	while(!atomic_load_explicit(reader->done,memory_order_acquire))
+	{
+		start = bench_now();
+		length = live_series_length(s);
+		if(length == 0)
+			continue;
+		newest = live_series_time(s,length-1);
+		from = live_series_find(s,newest-LIVE_WINDOW,length);
+		for(x=0;x<BENCH_CHANNELS;x++)
+			reader->sink += live_series_mean(s,x,from,length);
+		hdr_record(&reader->latency,(long)((bench_now() - start) * 1e9));
+
+		if(newest != (length-1) * LIVE_STEP)
+			reader->torn++;
+		else
+			for(x=0;x<BENCH_CHANNELS;x++)
+				if(live_series_value(s,length-1,x) != reader->c->column[x][length-1])
+				{
+					reader->torn++;
+					break;
+				}
+	}
+	return(NULL);
+}
@@ -0,0 +1,337 @@
+/*
+	cache
+	See cache.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+#define SUFFIX ".out"
+
+/* a result in the directory, for eviction */
+struct cache_entry {
+	char name[32];
+	struct timespec used;
+	long size;
+};
+
+static uint64_t rotate(uint64_t x, int bits);
+static uint64_t lane_round(uint64_t lane, uint64_t input);
+static uint64_t merge_round(uint64_t h, uint64_t lane);
+static uint64_t read64(const unsigned char *p);
+static uint32_t read32(const unsigned char *p);
+static void stripes(struct cache_hash *h, const unsigned char *p, size_t count);
+static void entry_path(struct cache *c, const char *name, char *path);
+static void evict(struct cache *c);
+static int compare_used(const void *a, const void *b);
+
+void cache_hash_init(struct cache_hash *h, uint64_t seed)
+{
+	memset(h,0,sizeof(*h));
+	h->seed = seed;
+	h->lane[0] = seed + PRIME1 + PRIME2;
+	h->lane[1] = seed + PRIME2;
+	h->lane[2] = seed;
+	h->lane[3] = seed - PRIME1;
+}
+
+/*
+	Take in the next `size` bytes
+*/
+void cache_hash_update(struct cache_hash *h, const void *data, size_t size)
+{
+	const unsigned char *p;
+	size_t take;
+
+	p = (const unsigned char *)data;
+	h->total += size;
+	if(h->pended)
+	{
+		take = 32 - h->pended;
+		if(take > size)
+			take = size;
+		memcpy(h->pending+h->pended,p,take);
+		h->pended += take;
+		p += take;
+		size -= take;
+		if(h->pended < 32)
+			return;
+		stripes(h,h->pending,1);
+		h->pended = 0;
+	}
+	stripes(h,p,size/32);
+	p += size - size%32;
+	memcpy(h->pending,p,size%32);
+	h->pended = size%32;
+}
+
+/*
+	The hash of everything taken in so far; more can be added after
+*/
+uint64_t cache_hash_digest(const struct cache_hash *h)
+{
+	const unsigned char *p,*end;
+	uint64_t digest;
+	int x;
+
+	if(h->total >= 32)
+	{
+		digest = rotate(h->lane[0],1) + rotate(h->lane[1],7) +
+				rotate(h->lane[2],12) + rotate(h->lane[3],18);
+		for(x=0;x<4;x++)
+			digest = merge_round(digest,h->lane[x]);
+	}
+	else
+		digest = h->seed + PRIME5;
+	digest += h->total;
+
+	p = h->pending;
+	end = p + h->pended;
+	for(;p+8<=end;p+=8)
+	{
+		digest ^= lane_round(0,read64(p));
+		digest = rotate(digest,27) * PRIME1 + PRIME4;
+	}
+	if(p+4 <= end)
+	{
+		digest ^= (uint64_t)read32(p) * PRIME1;
+		digest = rotate(digest,23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for(;p<end;p++)
+	{
+		digest ^= *p * PRIME5;
+		digest = rotate(digest,11) * PRIME1;
+	}
+
+	digest ^= digest >> 33;
+	digest *= PRIME2;
+	digest ^= digest >> 29;
+	digest *= PRIME3;
+	digest ^= digest >> 32;
+	return(digest);
+}
+
+/*
+	Use `dir` for the results, making it if need be, keeping them to
+	`max_bytes` in all
+	Returns 0 on success, -1 if the directory can't be used.
+*/
+int cache_open(struct cache *c, const char *dir, long max_bytes)
+{
+	if(strlen(dir) >= CACHE_DIR_SIZE)
+		return(-1);
+	if(mkdir(dir,0777) != 0 && errno != EEXIST)
+		return(-1);
+	if(access(dir,R_OK | W_OK | X_OK) != 0)
+		return(-1);
+	strcpy(c->dir,dir);
+	c->max_bytes = max_bytes;
+	return(0);
+}
+
+/*
+	The result stored for `key`, in a buffer to be freed, and its size
+	in *size; NULL if there is none
+*/
+char *cache_get(struct cache *c, uint64_t key, size_t *size)
+{
+	char name[32],path[CACHE_PATH_SIZE];
+	struct stat st;
+	char *data;
+	int fd;
+
+	snprintf(name,sizeof(name),"%016llx" SUFFIX,(unsigned long long)key);
+	entry_path(c,name,path);
+	fd = open(path,O_RDONLY);
+	if(fd < 0)
+		return(NULL);
+	data = NULL;
+	if(fstat(fd,&st) == 0 && (data = (char *)malloc(st.st_size+1)) != NULL)
+	{
+		if(read(fd,data,st.st_size) == st.st_size)
+		{
+			*size = st.st_size;
+			futimens(fd,NULL);			/* just used */
+		}
+		else
+		{
+			free(data);
+			data = NULL;
+		}
+	}
+	close(fd);
+	return(data);
+}
+
+/*
+	Store `size` bytes as the result for `key`, then make room
+	Returns 0 on success, -1 if it wasn't stored.
+*/
+int cache_put(struct cache *c, uint64_t key, const char *data, size_t size)
+{
+	char name[32],path[CACHE_PATH_SIZE],temporary[CACHE_PATH_SIZE+32];
+	FILE *fp;
+	int written;
+
+	if((long)size > c->max_bytes)
+		return(-1);
+	snprintf(name,sizeof(name),"%016llx" SUFFIX,(unsigned long long)key);
+	entry_path(c,name,path);
+	snprintf(temporary,sizeof(temporary),"%s.%ld.tmp",path,(long)getpid());
+	fp = fopen(temporary,"wb");
+	if(fp == NULL)
+		return(-1);
+	written = fwrite(data,1,size,fp) == size;
+	if(fclose(fp) != 0 || !written || rename(temporary,path) != 0)
+	{
+		unlink(temporary);
+		return(-1);
+	}
+	evict(c);
+	return(0);
+}
+
+static uint64_t rotate(uint64_t x, int bits)
+{
+	return( (x << bits) | (x >> (64 - bits)) );
+}
+
+static uint64_t lane_round(uint64_t lane, uint64_t input)
+{
+	lane += input * PRIME2;
+	lane = rotate(lane,31);
+	return(lane * PRIME1);
+}
+
+static uint64_t merge_round(uint64_t h, uint64_t lane)
+{
+	h ^= lane_round(0,lane);
+	return(h * PRIME1 + PRIME4);
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+	uint64_t x;
+
+	memcpy(&x,p,sizeof(x));
+	return(x);
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+	uint32_t x;
+
+	memcpy(&x,p,sizeof(x));
+	return(x);
+}
+
+/*
+	Run `count` whole 32 byte stripes through the four lanes
+*/
+static void stripes(struct cache_hash *h, const unsigned char *p, size_t count)
+{
+	uint64_t a,b,c,d;
+
+	a = h->lane[0];
+	b = h->lane[1];
+	c = h->lane[2];
+	d = h->lane[3];
+	for(;count>0;count--,p+=32)
+	{
+		a = lane_round(a,read64(p));
+		b = lane_round(b,read64(p+8));
+		c = lane_round(c,read64(p+16));
+		d = lane_round(d,read64(p+24));
+	}
+	h->lane[0] = a;
+	h->lane[1] = b;
+	h->lane[2] = c;
+	h->lane[3] = d;
+}
+
+static void entry_path(struct cache *c, const char *name, char *path)
+{
+	snprintf(path,CACHE_PATH_SIZE,"%s/%s",c->dir,name);
+}
+
+/*
+	Remove the least recently used results until the rest fit in
+	c->max_bytes
+*/
+static void evict(struct cache *c)
+{
+	DIR *dir;
+	struct dirent *d;
+	struct stat st;
+	struct cache_entry *entry,*grown;
+	char path[CACHE_PATH_SIZE];
+	size_t length;
+	long total;
+	int count,capacity,x;
+
+	dir = opendir(c->dir);
+	if(dir == NULL)
+		return;
+	entry = NULL;
+	count = capacity = 0;
+	total = 0;
+	while((d = readdir(dir)) != NULL)
+	{
+		length = strlen(d->d_name);
+		if(length >= sizeof(entry->name) || length < strlen(SUFFIX) ||
+				strcmp(d->d_name+length-strlen(SUFFIX),SUFFIX) != 0)
+			continue;
+		entry_path(c,d->d_name,path);
+		if(stat(path,&st) != 0)
+			continue;				/* removed by another process */
+		if(count == capacity)
+		{
+			capacity = capacity ? capacity*2 : 64;
+			grown = (struct cache_entry *)realloc(entry,capacity*sizeof(struct cache_entry));
+			if(grown == NULL)
+				break;
+			entry = grown;
+		}
+		strcpy(entry[count].name,d->d_name);
+		entry[count].used = st.st_mtim;
+		entry[count].size = st.st_size;
+		total += st.st_size;
+		count++;
+	}
+	closedir(dir);
+
+	if(total > c->max_bytes)
+	{
+		qsort(entry,count,sizeof(struct cache_entry),compare_used);
+		for(x=0;x<count && total>c->max_bytes;x++)
+		{
+			entry_path(c,entry[x].name,path);
+			if(unlink(path) == 0)
+				total -= entry[x].size;
+		}
+	}
+	free(entry);
+}
+
+/* oldest first */
+static int compare_used(const void *a, const void *b)
+{
+	const struct cache_entry *x = a, *y = b;
+
+	if(x->used.tv_sec != y->used.tv_sec)
+		return( (x->used.tv_sec > y->used.tv_sec) - (x->used.tv_sec < y->used.tv_sec) );
+	return( (x->used.tv_nsec > y->used.tv_nsec) - (x->used.tv_nsec < y->used.tv_nsec) );
+}
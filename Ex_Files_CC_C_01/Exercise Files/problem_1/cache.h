@@ -0,0 +1,52 @@
+/*
+	cache
+	Results kept on disk under a hash of what produced them, so the same
+	input asked for again is answered without being worked out again.
+
+	The hash is XXH64 (Yann Collet's xxHash, 64 bit), taken in pieces
+	as the input arrives: four lanes of multiply, rotate and multiply
+	over each 32 bytes, folded together and mixed at the end. It runs at
+	several bytes a cycle, far faster than the input can be parsed, and
+	isn't meant to stand up to anyone choosing inputs to collide. Words
+	are read in the machine's order, so a cache directory belongs to
+	machines of one byte order.
+
+	Each result is a file named by its 16 hex digit key in the cache
+	directory. Reading one marks it as just used, by its modification
+	time; after a result is stored the least recently used ones are
+	removed until the directory's results fit in its size. A result is
+	written to a temporary file and renamed into place, so several
+	processes can share the directory: a reader sees a whole result or
+	none.
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CACHE_DIR_SIZE 4000
+#define CACHE_PATH_SIZE 4096			/* the directory and a result's name */
+
+struct cache_hash {
+	uint64_t seed;
+	uint64_t lane[4];
+	unsigned char pending[32];	/* the bytes short of a whole stripe */
+	size_t pended;
+	uint64_t total;				/* bytes taken in */
+};
+
+struct cache {
+	char dir[CACHE_DIR_SIZE];
+	long max_bytes;				/* for all the results together */
+};
+
+void cache_hash_init(struct cache_hash *h, uint64_t seed);
+void cache_hash_update(struct cache_hash *h, const void *data, size_t size);
+uint64_t cache_hash_digest(const struct cache_hash *h);
+int cache_open(struct cache *c, const char *dir, long max_bytes);
+char *cache_get(struct cache *c, uint64_t key, size_t *size);
+int cache_put(struct cache *c, uint64_t key, const char *data, size_t size);
+
+#endif
@@ -0,0 +1,93 @@
+/*
+	comoment
+	See comoment.h
+*/
+
+#include <string.h>
+#include <math.h>
+#include "comoment.h"
+
+void comoment_init(struct comoment *m, int k)
+{
+	memset(m,0,sizeof(*m));
+	m->k = k;
+}
+
+/*
+	Take in `n` rows: variable i of row r is column[i][r*stride]
+*/
+void comoment_add(struct comoment *m, const float * const *column, int n, int stride)
+{
+	struct comoment block;
+	double before[COMOMENT_MAX],after;
+	int r,i,j;
+
+	comoment_init(&block,m->k);
+	for(r=0;r<n;r++)
+	{
+		block.n++;
+		for(i=0;i<m->k;i++)
+		{
+			before[i] = column[i][r*stride] - block.mean[i];
+			block.mean[i] += before[i] / block.n;
+		}
+		for(i=0;i<m->k;i++)
+		{
+			after = column[i][r*stride] - block.mean[i];
+			for(j=0;j<=i;j++)
+				block.m2[i][j] += before[j] * after;
+		}
+	}
+	comoment_merge(m,&block);
+}
+
+/*
+	Add the rows summed in `from` to `into`
+*/
+void comoment_merge(struct comoment *into, const struct comoment *from)
+{
+	double delta[COMOMENT_MAX],share,weight;
+	long n;
+	int i,j;
+
+	if(from->n == 0)
+		return;
+	n = into->n + from->n;
+	share = (double)from->n / n;
+	weight = (double)into->n * share;		/* into->n * from->n / n */
+	for(i=0;i<into->k;i++)
+		delta[i] = from->mean[i] - into->mean[i];
+	for(i=0;i<into->k;i++)
+	{
+		into->mean[i] += delta[i] * share;
+		for(j=0;j<=i;j++)
+			into->m2[i][j] += from->m2[i][j] + delta[i] * delta[j] * weight;
+	}
+	into->n = n;
+}
+
+/*
+	The sample covariance of variables i and j, NaN with fewer than two
+	rows
+*/
+double comoment_covariance(const struct comoment *m, int i, int j)
+{
+	if(m->n < 2)
+		return(NAN);
+	return((i >= j ? m->m2[i][j] : m->m2[j][i]) / (m->n - 1));
+}
+
+/*
+	Pearson's correlation of variables i and j, NaN if either is
+	constant
+*/
+double comoment_correlation(const struct comoment *m, int i, int j)
+{
+	double vi,vj;
+
+	vi = m->m2[i][i];
+	vj = m->m2[j][j];
+	if(m->n < 2 || vi <= 0 || vj <= 0)
+		return(NAN);
+	return((i >= j ? m->m2[i][j] : m->m2[j][i]) / sqrt(vi * vj));
+}
@@ -0,0 +1,34 @@
+/*
+	comoment
+	Means, covariances and Pearson correlations of several variables,
+	built up in one pass over the rows.
+
+	Each block of rows is first summed on its own, Welford's way: the
+	mean moves by each row's share of its distance from the mean, and
+	the co-moments grow by the product of the distances before and
+	after the move. The block is then merged into the running totals
+	(Chan, Golub and LeVeque), which only needs the two counts, means
+	and co-moments. The same merge combines the results of threads or
+	of separate shards of the data. Neither step subtracts large sums
+	of squares, so nothing is lost to cancellation.
+*/
+
+#ifndef COMOMENT_H
+#define COMOMENT_H
+
+#define COMOMENT_MAX 8				/* variables */
+
+struct comoment {
+	int k;							/* variables */
+	long n;							/* rows */
+	double mean[COMOMENT_MAX];
+	double m2[COMOMENT_MAX][COMOMENT_MAX];	/* sums of products of deviations */
+};
+
+void comoment_init(struct comoment *m, int k);
+void comoment_add(struct comoment *m, const float * const *column, int n, int stride);
+void comoment_merge(struct comoment *into, const struct comoment *from);
+double comoment_covariance(const struct comoment *m, int i, int j);
+double comoment_correlation(const struct comoment *m, int i, int j);
+
+#endif
@@ -10,45 +10,480 @@
 
 	That columnar data is treated as standard input. The value columns (3,4,5)
 	are manipulated.  The resulting average and mean for each column are
-	displayed.
+	displayed. A row whose date and time can't be read is left out of
+	every statistic, whichever are asked for.
 
 	Output is in plain text. If the --json switch is specified, output is
 	kludged into JSON
+
+	With --resample the rows are first put onto a uniform time grid (see
+	resample.h) and the statistics are computed over the grid points.
+
+	The median, trimmed mean and median absolute deviation all come from
+	the same in-place quickselect: no column is ever fully sorted.
+
+	When the input starts with a shared memory announcement from
+	`fetch_data --shm`, the rows are read from that ring (see shm_ring.h)
+	instead of being parsed from text.
+
+	Standard input is read a block at a time and split into rows, which
+	are parsed and stored a batch at a time. With --stats the time spent
+	in each of those stages, and in the statistics and the output, is
+	reported on stderr (see perf.h), with the latency percentiles of the
+	batches; --stats=json reports it as JSON.
+	With --trace FILE each block read, batch parsed and stored, column
+	summarised and the output are recorded as spans in Chrome trace
+	format (see trace.h).
+
+	With --histogram BINS[:MIN:MAX] the distribution of each column is
+	also reported. It is counted block by block as the values are
+	stored (see histogram.h), so it needs none of the stored columns.
+	Without a range each column has a default one, wide enough for the
+	readings of the lake.
+
+	With --correlation the covariance and Pearson correlation of every
+	pair of columns are reported too, from co-moments summed in the same
+	pass (see comoment.h).
+
+	With --trend the least-squares slope of each column against the
+	row timestamps is reported per hour, and the pressure's per three
+	hours: its tendency. --trend-bucket SECONDS also reports the slopes
+	of each period of that length, and --trend-window SECONDS the
+	slopes over that many seconds up to the end of each period. The
+	sums behind a slope merge (see trend.h), so a window is put
+	together from its periods' sums, with no second pass.
+
+	With --top K and --bottom K the K largest and smallest values of
+	each column are reported with the time of their rows. Only those K
+	are kept, in a heap per column (see extremes.h).
+
+	With --event CONDITION, e.g. --event wind>20:600, every stretch of
+	rows over which the column stays above (or below) the value for at
+	least that many seconds is reported with its start, end, duration
+	and peak (see events.h). Stretches run on across midnight when the
+	input covers several days, but not across a gap in the rows: one
+	ends an interval after its last row when the data stops.
+
+	With --time-weighted each row is also weighted by the time it
+	stands for, half the intervals to the rows either side, and the
+	time-weighted mean and median are reported as well (see
+	weighted.h), so a burst of rows or a gap doesn't pull the day's
+	figures toward the readings around it. The weighted mean is summed
+	as the rows go by; the median is selected in place, as the plain
+	one is, with the weights moved alongside the values.
+
+	The histogram, co-moments, trends, extremes, events and time weights
+	are all taken in as each block of rows is stored, see tally_rows().
+
+	With --cache DIR the whole input is read first, hashed as it comes
+	in, and the hash together with the options that shape the report is
+	looked up in DIR (see cache.h). A result found there is written out
+	as it is, with nothing parsed or selected; otherwise the report is
+	worked out as usual and stored for next time. The least recently
+	used results are removed to keep DIR within --cache-size MB, 64 by
+	default. Input from `fetch_data --shm` isn't cached.
+
+	With --follow FILE the rows are read from FILE instead, and it is
+	watched as it grows (with inotify). Whatever it holds is read
+	first; after that only the rows added to it are read, each batch of
+	them taken into running sums and a two-heap median per column (see
+	running_median.h), and the mean and median written again. The work
+	for an update is only that of the new rows; nothing is stored but
+	the heaps. It goes on until FILE is deleted or moved away; one that
+	is truncated is started over. The other statistics need every row
+	at once, so asking for any of them, or for --stats or --cache, along
+	with --follow is an error.
+
+	Compile with: cc -o crunch_data crunch_data.c resample.c timestamp.c shm_ring.c perf.c trace.c hdr_hist.c histogram.c comoment.c trend.c extremes.c events.c weighted.c cache.c running_median.c -lm
 */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "resample.h"
+#include "timestamp.h"
+#include "shm_ring.h"
+#include "perf.h"
+#include "trace.h"
+#include "histogram.h"
+#include "comoment.h"
+#include "trend.h"
+#include "extremes.h"
+#include "events.h"
+#include "weighted.h"
+#include "cache.h"
+#include "running_median.h"
 
-int read_row(char *line_of_text);
+#define ROW_SIZE 80
+#define COLUMNS 3
+#define INPUT_BLOCK 65536
+#define INPUT_ROWS 4096			/* rows split, parsed and stored at a time */
+#define TENDENCY_SECONDS 10800	/* pressure tendency is the change over 3 hours */
+#define PRESSURE 1				/* column */
+#define MAX_EVENTS 8			/* --event conditions */
+#define CACHE_MB 64				/* --cache-size default */
+/* part of every cache key: change it when the report changes */
+#define CACHE_FORMAT "crunch_data report 1"
+
+/* storage for the three sets of float values */
+struct readings {
+	float *column[COLUMNS];		/* air temperature, pressure, wind speed */
+	int count;
+	int capacity;
+	struct histogram *hist;		/* one per column, counted as stored, or NULL */
+	struct comoment *moments;	/* --correlation, summed as stored, or NULL */
+	struct trend_series *trend;	/* --trend, or NULL */
+	struct extremes *top;		/* --top, one per column, or NULL */
+	struct extremes *bottom;	/* --bottom */
+	struct event_detector *events;	/* --event, one per condition */
+	int conditions;
+	struct event_log *log;		/* the events they found */
+	struct time_weight *weighted;	/* --time-weighted, or NULL */
+	float *weight;				/* each row's seconds, with --time-weighted */
+};
+
+/* events found so far, for the report */
+struct event_log {
+	struct event *event;
+	int count;
+	int capacity;
+};
+
+/* statistics reported for each column */
+struct summary {
+	float mean;
+	float median;
+	float trimmed_mean;
+	float mad;
+	float weighted_median;
+};
+
+/* standard input, read a block at a time and split into rows */
+struct input {
+	int fd;
+	char *buffer;				/* INPUT_BLOCK bytes, and room for a '\0' */
+	size_t length;				/* bytes in `buffer` */
+	size_t pos;					/* start of the rows not yet split */
+	int eof;
+	int skipping;				/* discarding the rest of an overlong row */
+	char *row[INPUT_ROWS];		/* rows split by split_rows(), '\0' terminated */
+	int rows;
+};
+
+/* a batch of parsed rows */
+struct batch {
+	long t[INPUT_ROWS];
+	float v[INPUT_ROWS][COLUMNS];
+	int count;
+};
+
+/* --follow: all that's kept of the rows so far */
+struct follow_state {
+	char date_string[11];
+	long rows;
+	double sum[COLUMNS];
+	struct running_median median[COLUMNS];
+};
+
+/* which of the optional statistics to report */
+struct options {
+	int json_output;
+	float trim;					/* percent cut from each end, < 0 if unused */
+	int mad;
+	long trend_window;			/* seconds, 0 for each period's own trend */
+	const char *condition[MAX_EVENTS];	/* --event, as given */
+};
+
+static const char *plain_names[COLUMNS] = {
+	"Air Temperature", "Barometric Pressure", "Wind Speed"
+};
+static const char *json_names[COLUMNS] = {
+	"airTemperature", "barometricPressure", "windSpeed"
+};
+/* also accepted in --event conditions */
+static const char *short_names[COLUMNS] = {
+	"air", "pressure", "wind"
+};
+/* --histogram ranges when none is given: degrees F, inches of Hg, knots */
+static const float histogram_min[COLUMNS] = { -40, 28, 0 };
+static const float histogram_max[COLUMNS] = { 120, 32, 60 };
+
+void open_input(struct input *in, int fd);
+size_t read_block(struct input *in);
+int read_all(struct input *in, struct cache_hash *h);
+uint64_t result_key(struct cache_hash *input, int argc, char *argv[]);
+int split_rows(struct input *in);
 void process_row(int n,char *r,float *air,float *bar,float *wind);
 void set_date(char *row_string, char *date_string);
+void grow_readings(struct readings *data);
+void add_row(struct readings *data, struct resampler *rs, long t, const float *v);
+void read_ring(struct shm_ring *ring, struct readings *data, struct resampler *rs, char *date_string);
+void store_grid(const long *t, float * const *v, int n, void *userdata);
+void tally_rows(struct readings *data, const long *t, int t_stride, const float * const *column,
+		int stride, int n);
+void summarise(float *v, const float *w, int c, struct options *opt, struct summary *s);
+void output_plain(FILE *out, char *date_string, struct readings *data, struct options *opt, struct resampler *rs);
+void output_json(FILE *out, char *date_string, struct readings *data, struct options *opt, struct resampler *rs);
+void output_histogram(FILE *out, struct histogram *h, int json);
+void output_correlation(FILE *out, struct comoment *m, int json);
+void output_trend(FILE *out, struct trend_series *s, long window, int json);
+void print_json_number(FILE *out, double value);
+void output_extremes(FILE *out, struct extremes *e, int json);
+void store_event(const struct event *e, void *userdata);
+void output_events(FILE *out, struct event_log *log, struct options *opt, int json);
+int follow(const char *path, struct options *opt);
+void follow_reset(struct follow_state *f);
+void output_follow(struct follow_state *f, int json);
 float get_mean(float *v,int c);
 float get_median(float *v, int c);
-int compare(const void *a, const void *b);
+float get_trimmed_mean(float *v, int c, float pct);
+float get_mad(float *v, int c, float median);
+float select_kth(float *v, int lo, int hi, int k);
 
 int main(int argc, char *argv[])
 {
 	char date_string[11];		/* YYYY-MM-DD */
-	char row[80];
-	int row_count,json_output;
-	float *air_temp,*bar_press,*wind_speed;
+	char *row;
+	int a,r,x,resampling,first,ended,shm,stats,bins,ranged,correlation,trending;
+	int top,bottom,conditions,above,weighting,caching;
+	const char *cache_dir,*follow_path;
+	long cache_mb;
+	uint64_t key;
+	char *result;
+	size_t result_size;
+	FILE *out;
+	long min_seconds;
+	float threshold;
+	char name[EVENT_NAME_SIZE];
+	long bucket;
+	float low,high;
+	long step,max_gap;
+	int mode;
+	char *end,detail[24];
+	double started,batch_started;
+	struct input in;
+	struct batch *batch;
+	struct readings data;
+	struct resampler rs;
+	struct shm_ring ring;
+	struct options opt;
+	struct histogram hist[COLUMNS];
+	struct comoment moments;
+	struct trend_series trend;
+	struct extremes largest[COLUMNS],smallest[COLUMNS];
+	struct event_detector detector[MAX_EVENTS];
+	struct event_log log;
+	struct time_weight weights;
+	struct cache cache;
+	struct cache_hash hash;
+	const float *column[COLUMNS];
 	
-	/* check for the --json argument */
-	json_output = 0;
-	if(argc > 1)
+	/* check for the command line arguments */
+	opt.json_output = 0;
+	opt.trim = -1;
+	opt.mad = 0;
+	resampling = 0;
+	stats = 0;
+	bins = 0;
+	ranged = 0;
+	correlation = 0;
+	trending = 0;
+	bucket = 0;
+	top = bottom = 0;
+	conditions = 0;
+	weighting = 0;
+	cache_dir = NULL;
+	follow_path = NULL;
+	cache_mb = CACHE_MB;
+	memset(&log,0,sizeof(log));
+	opt.trend_window = 0;
+	for(a=1;a<argc;a++)
 	{
-		if( strcmp(argv[1],"--json") == 0)
-			json_output = 1;
-		else if( strcmp(argv[1],"--help") == 0)
+		if( strcmp(argv[a],"--json") == 0)
+			opt.json_output = 1;
+		else if( strcmp(argv[a],"--trimmed-mean") == 0 && a+1 < argc)
+		{
+			opt.trim = strtof(argv[++a],&end);
+			if(*end != '\0' || end == argv[a] || opt.trim < 0 || opt.trim >= 50)
+			{
+				fprintf(stderr,"crunch_data: Trim percentage must be from 0 up to 50\n");
+				return(1);
+			}
+		}
+		else if( strcmp(argv[a],"--mad") == 0)
+			opt.mad = 1;
+		else if( strcmp(argv[a],"--time-weighted") == 0)
+			weighting = 1;
+		else if( strcmp(argv[a],"--follow") == 0 && a+1 < argc)
+			follow_path = argv[++a];
+		else if( strcmp(argv[a],"--cache") == 0 && a+1 < argc)
+			cache_dir = argv[++a];
+		else if( strcmp(argv[a],"--cache-size") == 0 && a+1 < argc)
+		{
+			cache_mb = strtol(argv[++a],&end,10);
+			if(*end != '\0' || cache_mb <= 0)
+			{
+				fprintf(stderr,"crunch_data: Cache size must be a number of MB\n");
+				return(1);
+			}
+		}
+		else if( strcmp(argv[a],"--stats") == 0)
+			stats = 1;
+		else if( strcmp(argv[a],"--stats=json") == 0)
+			stats = 2;
+		else if( strcmp(argv[a],"--trace") == 0 && a+1 < argc)
+		{
+			if(trace_open(argv[++a]) != 0)
+			{
+				fprintf(stderr,"crunch_data: Unable to trace to %s\n",argv[a]);
+				return(1);
+			}
+			trace_thread_name("main");
+		}
+		else if( strcmp(argv[a],"--histogram") == 0 && a+1 < argc)
+		{
+			ranged = histogram_parse(argv[++a],&bins,&low,&high);
+			if(ranged < 0)
+			{
+				fprintf(stderr,"crunch_data: Improper histogram format: Use BINS[:MIN:MAX], up to %d bins\n",
+						HISTOGRAM_MAX_BINS);
+				return(1);
+			}
+		}
+		else if( strcmp(argv[a],"--correlation") == 0)
+			correlation = 1;
+		else if( (strcmp(argv[a],"--top") == 0 || strcmp(argv[a],"--bottom") == 0) && a+1 < argc)
+		{
+			x = (int)strtol(argv[a+1],&end,10);
+			if(*end != '\0' || x < 1 || x > EXTREMES_MAX)
+			{
+				fprintf(stderr,"crunch_data: %s takes a count from 1 to %d\n",argv[a],EXTREMES_MAX);
+				return(1);
+			}
+			if(strcmp(argv[a],"--top") == 0)
+				top = x;
+			else
+				bottom = x;
+			a++;
+		}
+		else if( strcmp(argv[a],"--event") == 0 && a+1 < argc)
+		{
+			if(conditions == MAX_EVENTS ||
+					event_parse(argv[++a],name,&above,&threshold,&min_seconds) != 0)
+			{
+				fprintf(stderr,"crunch_data: Improper event: Use COLUMN>VALUE[:SECONDS] or COLUMN<VALUE[:SECONDS], %d at most\n",
+						MAX_EVENTS);
+				return(1);
+			}
+			for(x=0;x<COLUMNS;x++)
+				if(strcmp(name,short_names[x]) == 0 || strcmp(name,json_names[x]) == 0)
+					break;
+			if(x == COLUMNS)
+			{
+				fprintf(stderr,"crunch_data: Unknown column %s: Use air, pressure or wind\n",name);
+				return(1);
+			}
+			event_init(&detector[conditions],conditions,x,above,threshold,min_seconds,store_event,&log);
+			opt.condition[conditions++] = argv[a];
+		}
+		else if( strcmp(argv[a],"--trend") == 0)
+			trending = 1;
+		else if( strcmp(argv[a],"--trend-bucket") == 0 && a+1 < argc)
+		{
+			bucket = strtol(argv[++a],&end,10);
+			if(*end != '\0' || bucket <= 0)
+			{
+				fprintf(stderr,"crunch_data: Trend bucket must be a number of seconds\n");
+				return(1);
+			}
+			trending = 1;
+		}
+		else if( strcmp(argv[a],"--trend-window") == 0 && a+1 < argc)
+		{
+			opt.trend_window = strtol(argv[++a],&end,10);
+			if(*end != '\0' || opt.trend_window <= 0)
+			{
+				fprintf(stderr,"crunch_data: Trend window must be a number of seconds\n");
+				return(1);
+			}
+			trending = 1;
+		}
+		else if( strcmp(argv[a],"--resample") == 0 && a+1 < argc)
+		{
+			if(resample_parse(argv[++a],&step,&mode,&max_gap) != 0)
+			{
+				fprintf(stderr,"crunch_data: Improper resample format: Use STEP[:linear|last[:MAXGAP]]\n");
+				return(1);
+			}
+			resampling = 1;
+		}
+		else if( strcmp(argv[a],"--help") == 0)
 		{
 			puts("crunch_data\nWritten by Dan Gookin, 2015\n");
 			puts("Manipulates input provided by the fetch_data program,");
 			puts("generating mean and median for Air Temperature, Barometric");
 			puts("Pressure, and Wind Speed. Format:\n");
-			puts("crunch_data [--json] [--help]\n");
-			puts("--json   Output data in JSON format");
-			puts("--help   Show this message");
+			puts("crunch_data [--json] [--trimmed-mean PCT] [--mad] [--time-weighted]");
+			puts("            [--resample STEP[:MODE[:MAXGAP]]] [--stats[=json]]");
+			puts("            [--histogram BINS[:MIN:MAX]] [--correlation]");
+			puts("            [--trend] [--trend-bucket SECONDS] [--trend-window SECONDS]");
+			puts("            [--top K] [--bottom K] [--event CONDITION] [--trace FILE]");
+			puts("            [--cache DIR [--cache-size MB]] [--help]");
+			puts("crunch_data [--json] --follow FILE\n");
+			puts("--json       Output data in JSON format");
+			puts("--trimmed-mean PCT");
+			puts("             Also report the mean with PCT percent of the values");
+			puts("             cut from each end");
+			puts("--mad        Also report the median absolute deviation");
+			puts("--time-weighted");
+			puts("             Also report the mean and median with each row");
+			puts("             weighted by the time it stands for, half the");
+			puts("             intervals to the rows either side");
+			puts("--histogram BINS[:MIN:MAX]");
+			puts("             Also report how many values fall in each of BINS");
+			puts("             equal bins from MIN up to MAX; each column has a");
+			puts("             range of its own by default");
+			puts("--correlation");
+			puts("             Also report the covariance and correlation of each");
+			puts("             pair of columns");
+			puts("--trend      Also report the trend of each column per hour, and the");
+			puts("             pressure tendency per 3 hours");
+			puts("--trend-bucket SECONDS");
+			puts("             Also report the trends of each period of SECONDS");
+			puts("--trend-window SECONDS");
+			puts("             Report the trends over SECONDS up to the end of each");
+			puts("             period instead; the period is 3600 s unless given");
+			puts("--top K, --bottom K");
+			puts("             Also report the K largest or smallest values of each");
+			puts("             column, and when they were read");
+			puts("--event COLUMN>VALUE[:SECONDS], --event COLUMN<VALUE[:SECONDS]");
+			puts("             Also report every stretch of rows where the column");
+			puts("             (air, pressure or wind) stays above or below VALUE");
+			puts("             for at least SECONDS; may be given more than once");
+			puts("--resample   Interpolate rows onto a grid of STEP seconds first;");
+			puts("             MODE is linear (default) or last, intervals longer");
+			puts("             than MAXGAP seconds (default 2*STEP) count as gaps");
+			puts("--stats      Report time per stage, throughput, allocations and");
+			puts("             peak memory and batch latency percentiles on");
+			puts("             stderr; --stats=json as JSON");
+			puts("--trace FILE Write the stages as spans in Chrome trace format,");
+			puts("             for chrome://tracing or ui.perfetto.dev");
+			puts("--cache DIR  Keep each report in DIR under a hash of the input and");
+			puts("             options, and answer the same again from there");
+			puts("--cache-size MB");
+			puts("             Remove the least recently used reports to keep DIR");
+			puts("             within MB megabytes (default 64)");
+			puts("--follow FILE");
+			puts("             Read FILE and keep reading the rows added to it,");
+			puts("             writing the mean and median again after each batch,");
+			puts("             until it is deleted or moved");
+			puts("--help       Show this message");
 			return(1);
 		}
 		else
@@ -57,83 +492,411 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	/* Process standard input (output from `fetch_data`) */
-	row_count = 0;
-	while(read_row(row))
+	if(follow_path)
 	{
-		/* This set of malloc()/realloc() operations are to dynamically allocate
-		storage for the three sets of float values */
-		if(row_count == 0)
+		/* only the mean and median are kept up as the file grows */
+		if(opt.trim >= 0 || opt.mad || weighting || bins || correlation || trending ||
+				top || bottom || conditions || resampling || cache_dir || stats)
 		{
-			set_date(row,date_string);
-			air_temp = (float *)malloc(sizeof(float)*1);
-			bar_press = (float *)malloc(sizeof(float)*1);
-			wind_speed = (float *)malloc(sizeof(float)*1);
+			fprintf(stderr,"crunch_data: --follow only reports the mean and median: Use it with --json or --trace alone\n");
+			return(1);
 		}
-		else
+		return(follow(follow_path,&opt));
+	}
+
+	if(stats)
+		perf_start();
+	memset(&data,0,sizeof(data));
+	if(bins)
+	{
+		for(x=0;x<COLUMNS;x++)
 		{
-			air_temp = (float *)realloc(air_temp,row_count*sizeof(float)+1);
-			bar_press = (float *)realloc(bar_press,row_count*sizeof(float)+1);
-			wind_speed = (float *)realloc(wind_speed,row_count*sizeof(float)+1);
-			if(air_temp == NULL || bar_press == NULL || wind_speed == NULL)
+			if(histogram_init(&hist[x],bins,ranged ? low : histogram_min[x],
+					ranged ? high : histogram_max[x]) != 0)
 			{
 				fprintf(stderr,"Unable to allocate memory for data storage.\n");
 				exit(1);
 			}
+			perf_alloc((bins+2)*sizeof(long));
+		}
+		data.hist = hist;
+	}
+	if(correlation)
+	{
+		comoment_init(&moments,COLUMNS);
+		data.moments = &moments;
+	}
+	if(trending)
+	{
+		if(opt.trend_window && bucket == 0)
+			bucket = 3600;
+		if(opt.trend_window % bucket != 0)
+		{
+			fprintf(stderr,"crunch_data: Trend window must be a whole number of buckets\n");
+			return(1);
+		}
+		trend_series_init(&trend,COLUMNS,bucket);
+		data.trend = &trend;
+	}
+	for(x=0;x<COLUMNS;x++)
+	{
+		if((top && extremes_init(&largest[x],top,1) != 0) ||
+				(bottom && extremes_init(&smallest[x],bottom,0) != 0))
+		{
+			fprintf(stderr,"Unable to allocate memory for data storage.\n");
+			exit(1);
+		}
+		perf_alloc((top+bottom)*sizeof(struct extreme));
+	}
+	data.top = top ? largest : NULL;
+	data.bottom = bottom ? smallest : NULL;
+	data.events = detector;
+	data.conditions = conditions;
+	data.log = &log;
+	if(weighting)
+	{
+		time_weight_init(&weights,COLUMNS);
+		data.weighted = &weights;
+	}
+	if(resampling)
+		resample_init(&rs,step,mode,max_gap,COLUMNS,store_grid,&data);
+	open_input(&in,STDIN_FILENO);
+	batch = (struct batch *)malloc(sizeof(struct batch));
+	if(batch == NULL)
+	{
+		fprintf(stderr,"Unable to allocate memory for data storage.\n");
+		exit(1);
+	}
+	perf_alloc(sizeof(struct batch));
+
+	/* a cached report is looked up by the whole input, so read it all first */
+	caching = 0;
+	key = 0;
+	if(cache_dir)
+	{
+		perf_enter(PERF_READ);
+		started = trace_now();
+		if(cache_open(&cache,cache_dir,cache_mb*1048576) != 0)
+			fprintf(stderr,"crunch_data: Unable to use %s as a cache, carrying on without it\n",
+					cache_dir);
+		else if(read_all(&in,&hash) == 0)
+		{
+			key = result_key(&hash,argc,argv);
+			result = cache_get(&cache,key,&result_size);
+			trace_span("crunch","read and hash input",started,NULL);
+			if(result)
+			{
+				perf.cache = "hit";
+				perf_enter(PERF_OUTPUT);
+				fwrite(result,1,result_size,stdout);
+				fflush(stdout);
+				free(result);
+				if(stats)
+				{
+					perf_stop();
+					perf_report(stderr,stats == 2);
+				}
+				return(0);
+			}
+			perf.cache = "miss";
+			caching = 1;
 		}
-		process_row(row_count,row,air_temp,bar_press,wind_speed);
-		row_count++;
+	}
+
+	/* Process standard input (output from `fetch_data`) */
+	date_string[0] = '\0';
+	first = 1;
+	ended = 0;
+	shm = 0;
+	while(!ended)
+	{
+		perf_enter(PERF_SPLIT);
+		started = trace_now();
+		batch_started = stats ? perf_now() : 0;
+		if(split_rows(&in) == 0)
+		{
+			if(in.eof)
+				break;
+			perf_enter(PERF_READ);
+			started = trace_now();
+			read_block(&in);
+			trace_span("crunch","read block",started,NULL);
+			continue;
+		}
+		trace_span("crunch","split",started,NULL);
+
+		perf_enter(PERF_PARSE);
+		started = trace_now();
+		batch->count = 0;
+		for(r=0;r<in.rows;r++)
+		{
+			row = in.row[r];
+			/* a blank line ends the input */
+			if(*row == '\0')
+			{
+				ended = 1;
+				break;
+			}
+			if(row[0] == '#')
+			{
+				/* `fetch_data --shm` offers the rows in shared memory */
+				if(first && shm_ring_attach(&ring,row,COLUMNS) == 0)
+				{
+					shm = ended = 1;
+					break;
+				}
+				continue;
+			}
+			first = 0;
+			x = batch->count;
+			/* a row without a proper time is left out whatever's asked for */
+			batch->t[x] = parse_timestamp(row);
+			if(batch->t[x] < 0)
+				continue;
+			if(date_string[0] == '\0')
+				set_date(row,date_string);
+			process_row(0,row,&batch->v[x][0],&batch->v[x][1],&batch->v[x][2]);
+			batch->count++;
+		}
+
+		if(trace_enabled)
+		{
+			snprintf(detail,sizeof(detail),"%d rows",batch->count);
+			trace_span("crunch","parse batch",started,detail);
+		}
+
+		perf_enter(PERF_AGGREGATE);
+		started = trace_now();
+		for(x=0;x<batch->count;x++)
+			add_row(&data,resampling ? &rs : NULL,batch->t[x],batch->v[x]);
+		/* resampled values are taken in as they come off the grid */
+		if(!resampling)
+		{
+			for(x=0;x<COLUMNS;x++)
+				column[x] = &batch->v[0][x];
+			tally_rows(&data,batch->t,1,column,COLUMNS,batch->count);
+		}
+		perf.rows += batch->count;
+		perf_batch(batch_started);
+		trace_span("crunch","aggregate batch",started,detail);
+	}
+	if(shm)
+	{
+		read_ring(&ring,&data,resampling ? &rs : NULL,date_string);
+		shm_ring_detach(&ring);
+	}
+	perf_enter(PERF_AGGREGATE);
+	if(resampling)
+		resample_flush(&rs);
+	for(x=0;x<conditions;x++)
+		event_finish(&detector[x]);
+
+	if(data.count == 0)
+	{
+		fprintf(stderr,"crunch_data: No data to process.\n");
+		return(1);
 	}
 
 	/* Output results */
-	if(json_output)
-	{
-		printf("{ \"%s\": {\n",date_string);
-		printf("  \"airTemperature\": {\"mean\": %f, \"median\": %f },\n",
-				get_mean(air_temp,row_count),
-				get_median(air_temp,row_count));
-		printf("  \"barometricPressure\": { \"mean\": %f, \"median\": %f },\n",
-				get_mean(bar_press,row_count),
-				get_median(bar_press,row_count));
-		printf("  \"windSpeed\": { \"mean\": %f, \"median\": %f }\n",
-				get_mean(wind_speed,row_count),
-				get_median(wind_speed,row_count));
-		printf("}\n}\n");
+	perf_enter(PERF_OUTPUT);
+	started = trace_now();
+	/* a report to be cached is written to memory first */
+	out = stdout;
+	if(caching)
+	{
+		out = open_memstream(&result,&result_size);
+		if(out == NULL)
+		{
+			out = stdout;
+			caching = 0;
+		}
 	}
+	if(opt.json_output)
+		output_json(out,date_string,&data,&opt,resampling ? &rs : NULL);
 	else	/* tabular output */
-	{	
-		printf("%s\n",date_string);
-		printf("\tAir Temperature\n");
-		printf("\t\tMean\t%f\n",get_mean(air_temp,row_count));
-		printf("\t\tMedian\t%f\n",get_median(air_temp,row_count));
-		printf("\tBarometric Pressure\n");
-		printf("\t\tMean\t%f\n",get_mean(bar_press,row_count));
-		printf("\t\tMedian\t%f\n",get_median(bar_press,row_count));
-		printf("\tWind Speed\n");
-		printf("\t\tMean\t%f\n",get_mean(wind_speed,row_count));
-		printf("\t\tMedian\t%f\n",get_median(wind_speed,row_count));
+		output_plain(out,date_string,&data,&opt,resampling ? &rs : NULL);
+	if(caching)
+	{
+		fclose(out);
+		fwrite(result,1,result_size,stdout);
+		cache_put(&cache,key,result,result_size);
+		free(result);
 	}
+	fflush(stdout);
+	trace_span("crunch","output",started,NULL);
 
+	if(stats)
+	{
+		perf_stop();
+		perf_report(stderr,stats == 2);
+	}
 	return(0);
 }
 
+void open_input(struct input *in, int fd)
+{
+	memset(in,0,sizeof(*in));
+	in->fd = fd;
+	in->buffer = (char *)malloc(INPUT_BLOCK+1);
+	if(in->buffer == NULL)
+	{
+		fprintf(stderr,"Unable to allocate memory for data storage.\n");
+		exit(1);
+	}
+	perf_alloc(INPUT_BLOCK+1);
+}
+
 /*
-	Read a line of standard input and store it in `line_of_text` buffer
-	Returns characters read, which isn't used in the main() function.
+	Refill the input buffer, keeping the unfinished row at the end of
+	the last block. Whatever is available is taken, so a first line
+	from `fetch_data --shm` isn't kept waiting for a full block.
+	Returns bytes read, 0 at the end of the input.
 */
-int read_row(char *line_of_text)
+size_t read_block(struct input *in)
 {
-	char c;
-	int offset = 0;
-	
-	while( (c=fgetc(stdin)) != EOF )
+	ssize_t n;
+
+	in->length -= in->pos;
+	memmove(in->buffer,in->buffer+in->pos,in->length);
+	in->pos = 0;
+	do
+		n = read(in->fd,in->buffer+in->length,INPUT_BLOCK-in->length);
+	while(n < 0 && errno == EINTR);
+	if(n <= 0)
 	{
-		if(c=='\n')
+		in->eof = 1;
+		return(0);
+	}
+	in->length += n;
+	perf.bytes += n;
+	return((size_t)n);
+}
+
+/*
+	Read the rest of the input into the buffer, growing it to hold it
+	all, and hash it as it comes in. The buffer is then split as one
+	last block. Returns 0 on success, -1 if the input is a
+	`fetch_data --shm` announcement, which is left to be read as usual.
+*/
+int read_all(struct input *in, struct cache_hash *h)
+{
+	size_t capacity;
+	ssize_t n;
+	char *grown;
+
+	cache_hash_init(h,0);
+	read_block(in);
+	if(in->length >= strlen(SHM_RING_TAG) && strncmp(in->buffer,SHM_RING_TAG,strlen(SHM_RING_TAG)) == 0)
+		return(-1);
+	cache_hash_update(h,in->buffer,in->length);
+	capacity = INPUT_BLOCK;
+	while(!in->eof)
+	{
+		if(in->length == capacity)
+		{
+			capacity *= 2;
+			perf_alloc(capacity+1);
+			grown = (char *)realloc(in->buffer,capacity+1);
+			if(grown == NULL)
+			{
+				fprintf(stderr,"Unable to allocate memory for data storage.\n");
+				exit(1);
+			}
+			in->buffer = grown;
+		}
+		do
+			n = read(in->fd,in->buffer+in->length,capacity-in->length);
+		while(n < 0 && errno == EINTR);
+		if(n <= 0)
+		{
+			in->eof = 1;
 			break;
-		*(line_of_text+offset) = c;
-		offset++;
+		}
+		cache_hash_update(h,in->buffer+in->length,n);
+		in->length += n;
+		perf.bytes += n;
+	}
+	return(0);
+}
+
+/*
+	The cache key: the input's hash, carried on through the options that
+	shape the report, so the same input crunched another way is kept
+	apart. --stats, --trace and the cache's own options don't count.
+*/
+uint64_t result_key(struct cache_hash *input, int argc, char *argv[])
+{
+	struct cache_hash h;
+	int a;
+
+	cache_hash_init(&h,cache_hash_digest(input));
+	cache_hash_update(&h,CACHE_FORMAT,strlen(CACHE_FORMAT)+1);
+	for(a=1;a<argc;a++)
+	{
+		if(strcmp(argv[a],"--stats") == 0 || strcmp(argv[a],"--stats=json") == 0)
+			continue;
+		if((strcmp(argv[a],"--trace") == 0 || strcmp(argv[a],"--cache") == 0 ||
+				strcmp(argv[a],"--cache-size") == 0) && a+1 < argc)
+		{
+			a++;
+			continue;
+		}
+		cache_hash_update(&h,argv[a],strlen(argv[a])+1);
+	}
+	return(cache_hash_digest(&h));
+}
+
+/*
+	Find the complete rows in the buffer, up to INPUT_ROWS of them, and
+	'\0' terminate them in place. At the end of the input a last row
+	without a newline counts too. Rows longer than ROW_SIZE are
+	truncated, as they always have been. Returns the rows found, 0 if
+	another block is needed.
+*/
+int split_rows(struct input *in)
+{
+	char *start,*newline,*end;
+
+	in->rows = 0;
+	end = in->buffer + in->length;
+	while(in->rows < INPUT_ROWS && in->pos < in->length)
+	{
+		start = in->buffer + in->pos;
+		newline = memchr(start,'\n',end-start);
+		if(newline == NULL)
+		{
+			if(in->skipping)
+			{
+				in->pos = in->length;
+				break;
+			}
+			if(!in->eof)
+			{
+				if(in->pos > 0 || in->length < INPUT_BLOCK)
+					break;			/* finish it from the next block */
+				/* a whole block without a newline: keep the start */
+				in->row[in->rows++] = start;
+				start[ROW_SIZE-1] = '\0';
+				in->skipping = 1;
+				in->pos = in->length;
+				break;
+			}
+			newline = end;
+		}
+		in->pos = newline - in->buffer + 1;
+		if(in->pos > in->length)
+			in->pos = in->length;
+		if(in->skipping)
+		{
+			in->skipping = 0;
+			continue;
+		}
+		*newline = '\0';
+		if(newline - start >= ROW_SIZE)
+			start[ROW_SIZE-1] = '\0';
+		in->row[in->rows++] = start;
 	}
-	return(offset);
+	return(in->rows);
 }
 
 /*
@@ -172,6 +935,699 @@ void set_date(char *row_string, char *date_string)
 	*(date_string+x) = '\0';
 }
 
+/*
+	Double the storage for the three sets of float values. Growing
+	geometrically keeps the number of realloc() calls logarithmic in
+	the number of rows.
+*/
+void grow_readings(struct readings *data)
+{
+	int x;
+
+	data->capacity = data->capacity ? data->capacity*2 : 1024;
+	for(x=0;x<COLUMNS;x++)
+	{
+		perf_alloc(data->capacity*sizeof(float));
+		data->column[x] = (float *)realloc(data->column[x],data->capacity*sizeof(float));
+		if(data->column[x] == NULL)
+		{
+			fprintf(stderr,"Unable to allocate memory for data storage.\n");
+			exit(1);
+		}
+	}
+	if(data->weighted)
+	{
+		perf_alloc(data->capacity*sizeof(float));
+		data->weight = (float *)realloc(data->weight,data->capacity*sizeof(float));
+		if(data->weight == NULL)
+		{
+			fprintf(stderr,"Unable to allocate memory for data storage.\n");
+			exit(1);
+		}
+	}
+}
+
+/*
+	Take in one row, through the resampler if there is one
+*/
+void add_row(struct readings *data, struct resampler *rs, long t, const float *v)
+{
+	int x;
+
+	if(rs)
+	{
+		resample_push(rs,t,v);
+		return;
+	}
+	if(data->count == data->capacity)
+		grow_readings(data);
+	for(x=0;x<COLUMNS;x++)
+		*(data->column[x]+data->count) = v[x];
+	data->count++;
+}
+
+/*
+	Take in every row from the shared memory ring, reading them where
+	they lie in the ring
+*/
+void read_ring(struct shm_ring *ring, struct readings *data, struct resampler *rs, char *date_string)
+{
+	struct shm_row *rows;
+	const float *column[COLUMNS];
+	char stamp[TIMESTAMP_SIZE];
+	double started,batch_started;
+	long n,x;
+
+	perf_enter(PERF_READ);
+	while((n = shm_ring_read(ring,&rows)) > 0)
+	{
+		perf_enter(PERF_AGGREGATE);
+		started = trace_now();
+		batch_started = perf.enabled ? perf_now() : 0;
+		if(date_string[0] == '\0')
+		{
+			format_timestamp(rows[0].t,stamp);
+			set_date(stamp,date_string);
+		}
+		for(x=0;x<n;x++)
+			add_row(data,rs,rows[x].t,rows[x].v);
+		if(rs == NULL)
+		{
+			for(x=0;x<COLUMNS;x++)
+				column[x] = &rows[0].v[x];
+			tally_rows(data,&rows[0].t,sizeof(struct shm_row)/sizeof(long),column,
+					sizeof(struct shm_row)/sizeof(float),n);
+		}
+		shm_ring_release(ring,n);
+		perf.rows += n;
+		perf.bytes += n*sizeof(struct shm_row);
+		perf_batch(batch_started);
+		trace_span("crunch","aggregate ring rows",started,NULL);
+		perf_enter(PERF_READ);
+	}
+}
+
+/*
+	Callback for the resampler: append a block of grid points
+*/
+void store_grid(const long *t, float * const *v, int n, void *userdata)
+{
+	struct readings *data;
+	int x;
+
+	data = (struct readings *)userdata;
+	while(data->count + n > data->capacity)
+		grow_readings(data);
+	for(x=0;x<COLUMNS;x++)
+		memcpy(data->column[x]+data->count,v[x],n*sizeof(float));
+	data->count += n;
+	tally_rows(data,t,1,(const float * const *)v,1,n);
+}
+
+/*
+	Take a block of `n` stored rows into the statistics that are kept
+	as the rows go by. Row r's time is t[r*t_stride] and its value for
+	column c is column[c][r*stride]. The rows are the last `n` stored.
+*/
+void tally_rows(struct readings *data, const long *t, int t_stride, const float * const *column,
+		int stride, int n)
+{
+	float row[COLUMNS];
+	double half;
+	int r,x,stored;
+
+	if(data->hist)
+		for(x=0;x<COLUMNS;x++)
+			histogram_add(&data->hist[x],column[x],n,stride);
+	if(data->moments)
+		comoment_add(data->moments,column,n,stride);
+	if(data->top || data->bottom)
+	{
+		for(r=0;r<n;r++)
+		{
+			for(x=0;x<COLUMNS;x++)
+			{
+				if(data->top)
+					extremes_add(&data->top[x],column[x][r*stride],t[r*t_stride]);
+				if(data->bottom)
+					extremes_add(&data->bottom[x],column[x][r*stride],t[r*t_stride]);
+			}
+		}
+	}
+	if(data->trend || data->conditions || data->weighted)
+	{
+		stored = data->count - n;
+		for(r=0;r<n;r++)
+		{
+			for(x=0;x<COLUMNS;x++)
+				row[x] = column[x][r*stride];
+			if(data->trend && trend_series_add(data->trend,t[r*t_stride],row) != 0)
+			{
+				fprintf(stderr,"Unable to allocate memory for data storage.\n");
+				exit(1);
+			}
+			for(x=0;x<data->conditions;x++)
+				event_feed(&data->events[x],t[r*t_stride],row);
+			if(data->weighted)
+			{
+				/* half the interval goes to each of the two rows */
+				half = time_weight_add(data->weighted,t[r*t_stride],row) / 2;
+				if(stored + r > 0)
+					data->weight[stored+r-1] += half;
+				data->weight[stored+r] = half;
+			}
+		}
+	}
+}
+
+/*
+	Compute the statistics for one column. The column is reordered by the
+	selections and overwritten by the MAD, so it can't be used afterwards.
+	`w` holds the rows' time weights, or is NULL; they are left alone, as
+	every column needs them in row order.
+*/
+void summarise(float *v, const float *w, int c, struct options *opt, struct summary *s)
+{
+	double started;
+	float *weight;
+	int caller;
+
+	started = trace_now();
+	caller = perf_enter(PERF_AGGREGATE);
+	s->mean = get_mean(v,c);
+	trace_span("crunch","mean",started,NULL);
+	perf_enter(PERF_MEDIAN);
+	started = trace_now();
+	/* first, while each value still has its weight beside it */
+	if(w)
+	{
+		perf_alloc(c*sizeof(float));
+		weight = (float *)malloc(c*sizeof(float));
+		if(weight == NULL)
+		{
+			fprintf(stderr,"Unable to allocate memory for data storage.\n");
+			exit(1);
+		}
+		memcpy(weight,w,c*sizeof(float));
+		s->weighted_median = weighted_median(v,weight,c);
+		free(weight);
+	}
+	s->median = get_median(v,c);
+	/* both of these rely on the partition left behind by get_median() */
+	if(opt->trim >= 0)
+		s->trimmed_mean = get_trimmed_mean(v,c,opt->trim);
+	if(opt->mad)
+		s->mad = get_mad(v,c,s->median);
+	trace_span("crunch","selections",started,NULL);
+	perf_enter(caller);
+}
+
+/*
+	Tabular output. `rs` is NULL unless the input was resampled.
+*/
+void output_plain(FILE *out, char *date_string, struct readings *data, struct options *opt, struct resampler *rs)
+{
+	struct summary s;
+	int x;
+
+	fprintf(out,"%s\n",date_string);
+	for(x=0;x<COLUMNS;x++)
+	{
+		summarise(data->column[x],data->weight,data->count,opt,&s);
+		fprintf(out,"\t%s\n",plain_names[x]);
+		fprintf(out,"\t\tMean\t%f\n",s.mean);
+		fprintf(out,"\t\tMedian\t%f\n",s.median);
+		if(data->weighted)
+		{
+			fprintf(out,"\t\tTW mean\t%f\n",time_weight_mean(data->weighted,x));
+			fprintf(out,"\t\tTW median\t%f\n",s.weighted_median);
+		}
+		if(opt->trim >= 0)
+			fprintf(out,"\t\tTrimmed\t%f\n",s.trimmed_mean);
+		if(opt->mad)
+			fprintf(out,"\t\tMAD\t%f\n",s.mad);
+		if(data->hist)
+			output_histogram(out,&data->hist[x],0);
+		if(data->top)
+			output_extremes(out,&data->top[x],0);
+		if(data->bottom)
+			output_extremes(out,&data->bottom[x],0);
+		if(data->trend)
+		{
+			fprintf(out,"\t\tTrend\t%f per hour\n",trend_slope(&data->trend->whole,x) * 3600);
+			if(x == PRESSURE)
+				fprintf(out,"\t\tTendency\t%f per 3 hours\n",
+						trend_slope(&data->trend->whole,x) * TENDENCY_SECONDS);
+		}
+	}
+	if(data->moments)
+		output_correlation(out,data->moments,0);
+	if(data->trend && data->trend->bucket)
+		output_trend(out,data->trend,opt->trend_window,0);
+	if(data->conditions)
+		output_events(out,data->log,opt,0);
+	if(rs)
+	{
+		fprintf(out,"\tResampling\n");
+		fprintf(out,"\t\tGrid\t%ld s %s\n",rs->step,resample_mode_name(rs->mode));
+		fprintf(out,"\t\tSamples\t%ld\n",rs->stats.samples);
+		fprintf(out,"\t\tDropped\t%ld\n",rs->stats.dropped);
+		fprintf(out,"\t\tPoints\t%ld\n",rs->stats.points);
+		fprintf(out,"\t\tGaps\t%ld\n",rs->stats.gaps);
+		fprintf(out,"\t\tFilled\t%ld\n",rs->stats.filled);
+		fprintf(out,"\t\tLongest\t%ld s\n",rs->stats.longest);
+	}
+}
+
+/*
+	JSON output. `rs` is NULL unless the input was resampled.
+*/
+void output_json(FILE *out, char *date_string, struct readings *data, struct options *opt, struct resampler *rs)
+{
+	struct summary s;
+	int x;
+
+	fprintf(out,"{ \"%s\": {\n",date_string);
+	for(x=0;x<COLUMNS;x++)
+	{
+		summarise(data->column[x],data->weight,data->count,opt,&s);
+		fprintf(out,"  \"%s\": { \"mean\": %f, \"median\": %f",json_names[x],s.mean,s.median);
+		if(data->weighted)
+			fprintf(out,", \"timeWeightedMean\": %f, \"timeWeightedMedian\": %f",
+					time_weight_mean(data->weighted,x),s.weighted_median);
+		if(opt->trim >= 0)
+			fprintf(out,", \"trimmedMean\": %f",s.trimmed_mean);
+		if(opt->mad)
+			fprintf(out,", \"mad\": %f",s.mad);
+		if(data->hist)
+			output_histogram(out,&data->hist[x],1);
+		if(data->top)
+			output_extremes(out,&data->top[x],1);
+		if(data->bottom)
+			output_extremes(out,&data->bottom[x],1);
+		if(data->trend)
+		{
+			fprintf(out,", \"trendPerHour\": ");
+			print_json_number(out,trend_slope(&data->trend->whole,x) * 3600);
+			if(x == PRESSURE)
+			{
+				fprintf(out,", \"tendencyPer3Hours\": ");
+				print_json_number(out,trend_slope(&data->trend->whole,x) * TENDENCY_SECONDS);
+			}
+		}
+		fprintf(out," }%s",x < COLUMNS-1 ? ",\n" : "");
+	}
+	if(data->moments)
+		output_correlation(out,data->moments,1);
+	if(data->trend && data->trend->bucket)
+		output_trend(out,data->trend,opt->trend_window,1);
+	if(data->conditions)
+		output_events(out,data->log,opt,1);
+	if(rs)
+	{
+		fprintf(out,",\n  \"resampling\": { \"step\": %ld, \"mode\": \"%s\", ",
+				rs->step,resample_mode_name(rs->mode));
+		fprintf(out,"\"samples\": %ld, \"dropped\": %ld, \"points\": %ld, ",
+				rs->stats.samples,rs->stats.dropped,rs->stats.points);
+		fprintf(out,"\"gaps\": %ld, \"filled\": %ld, \"longestGap\": %ld }",
+				rs->stats.gaps,rs->stats.filled,rs->stats.longest);
+	}
+	fprintf(out,"\n}\n}\n");
+}
+
+/*
+	A column's histogram: one line per bin, headed by its lower edge, or
+	a member of the column's JSON object
+*/
+void output_histogram(FILE *out, struct histogram *h, int json)
+{
+	int b;
+
+	if(json)
+	{
+		fprintf(out,", \"histogram\": { \"min\": %f, \"max\": %f, \"below\": %ld, \"above\": %ld, \"counts\": [",
+				h->min,h->max,h->count[0],h->count[h->bins+1]);
+		for(b=1;b<=h->bins;b++)
+			fprintf(out,"%s%ld",b > 1 ? ", " : " ",h->count[b]);
+		fprintf(out," ] }");
+		return;
+	}
+	fprintf(out,"\t\tHistogram\n");
+	fprintf(out,"\t\t\tBelow\t%ld\n",h->count[0]);
+	for(b=1;b<=h->bins;b++)
+		fprintf(out,"\t\t\t%f\t%ld\n",h->min + (b-1) / h->scale,h->count[b]);
+	fprintf(out,"\t\t\tAbove\t%ld\n",h->count[h->bins+1]);
+}
+
+/*
+	The covariance and correlation matrices, a row per column, or as
+	members of the day's JSON object
+*/
+void output_correlation(FILE *out, struct comoment *m, int json)
+{
+	const char *matrix[2] = { "covariance", "correlation" };
+	double value;
+	int k,x,y;
+
+	if(json)
+	{
+		for(k=0;k<2;k++)
+		{
+			fprintf(out,",\n  \"%s\": [",matrix[k]);
+			for(x=0;x<COLUMNS;x++)
+			{
+				fprintf(out,"%s[",x ? ", " : " ");
+				for(y=0;y<COLUMNS;y++)
+				{
+					value = k ? comoment_correlation(m,x,y) : comoment_covariance(m,x,y);
+					fprintf(out,"%s",y ? ", " : " ");
+					print_json_number(out,value);
+				}
+				fprintf(out," ]");
+			}
+			fprintf(out," ]");
+		}
+		return;
+	}
+	for(k=0;k<2;k++)
+	{
+		fprintf(out,"\t%s\n",k ? "Correlation" : "Covariance");
+		for(x=0;x<COLUMNS;x++)
+		{
+			fprintf(out,"\t\t%-20s",plain_names[x]);
+			for(y=0;y<COLUMNS;y++)
+				fprintf(out,"\t%f",k ? comoment_correlation(m,x,y) : comoment_covariance(m,x,y));
+			fprintf(out,"\n");
+		}
+	}
+}
+
+/*
+	The trend of each period per hour, or over the `window` up to its
+	end, a line per period or a member of the day's JSON object
+*/
+void output_trend(FILE *out, struct trend_series *s, long window, int json)
+{
+	struct trend tr;
+	char stamp[TIMESTAMP_SIZE];
+	int p,x;
+
+	if(json)
+		fprintf(out,",\n  \"trend\": { \"bucket\": %ld, \"window\": %ld, \"periods\": [",s->bucket,window);
+	else
+		fprintf(out,"\tTrend per hour, %s %ld s\n",window ? "over" : "each",window ? window : s->bucket);
+	for(p=0;p<s->periods;p++)
+	{
+		if(window)
+			trend_series_window(s,p,window,&tr);
+		else
+			tr = s->period[p];
+		format_timestamp(s->start[p],stamp);
+		if(json)
+		{
+			fprintf(out,"%s\n    { \"start\": \"%s\", \"rows\": %ld",p ? "," : "",stamp,tr.n);
+			for(x=0;x<COLUMNS;x++)
+			{
+				fprintf(out,", \"%s\": ",json_names[x]);
+				print_json_number(out,trend_slope(&tr,x) * 3600);
+			}
+			fprintf(out," }");
+			continue;
+		}
+		fprintf(out,"\t\t%s",stamp);
+		for(x=0;x<COLUMNS;x++)
+			fprintf(out,"\t%f",trend_slope(&tr,x) * 3600);
+		fprintf(out,"\n");
+	}
+	if(json)
+		fprintf(out," ] }");
+}
+
+/*
+	A column's largest or smallest values, most extreme first, with the
+	time of each
+*/
+void output_extremes(FILE *out, struct extremes *e, int json)
+{
+	struct extreme *sorted;
+	char stamp[TIMESTAMP_SIZE];
+	int n,x;
+
+	sorted = (struct extreme *)malloc(e->k*sizeof(struct extreme));
+	if(sorted == NULL)
+	{
+		fprintf(stderr,"Unable to allocate memory for data storage.\n");
+		exit(1);
+	}
+	n = extremes_sorted(e,sorted);
+	if(json)
+		fprintf(out,", \"%s\": [",e->largest ? "top" : "bottom");
+	else
+		fprintf(out,"\t\t%s %d\n",e->largest ? "Top" : "Bottom",e->k);
+	for(x=0;x<n;x++)
+	{
+		format_timestamp(sorted[x].t,stamp);
+		if(json)
+			fprintf(out,"%s{ \"value\": %f, \"time\": \"%s\" }",x ? ", " : " ",sorted[x].v,stamp);
+		else
+			fprintf(out,"\t\t\t%f\t%s\n",sorted[x].v,stamp);
+	}
+	if(json)
+		fprintf(out," ]");
+	free(sorted);
+}
+
+/*
+	Callback for the event detectors: keep an event for the report
+*/
+void store_event(const struct event *e, void *userdata)
+{
+	struct event_log *log;
+	struct event *grown;
+
+	log = (struct event_log *)userdata;
+	if(log->count == log->capacity)
+	{
+		log->capacity = log->capacity ? log->capacity*2 : 64;
+		perf_alloc(log->capacity*sizeof(struct event));
+		grown = (struct event *)realloc(log->event,log->capacity*sizeof(struct event));
+		if(grown == NULL)
+		{
+			fprintf(stderr,"Unable to allocate memory for data storage.\n");
+			exit(1);
+		}
+		log->event = grown;
+	}
+	log->event[log->count++] = *e;
+}
+
+/*
+	The events in the order they ended, a line each under their
+	condition, or a member of the day's JSON object
+*/
+void output_events(FILE *out, struct event_log *log, struct options *opt, int json)
+{
+	struct event *e;
+	char start[TIMESTAMP_SIZE],end[TIMESTAMP_SIZE],peak[TIMESTAMP_SIZE];
+	int x;
+
+	if(json)
+		fprintf(out,",\n  \"events\": [");
+	else
+		fprintf(out,"\tEvents\n");
+	for(x=0;x<log->count;x++)
+	{
+		e = &log->event[x];
+		format_timestamp(e->start,start);
+		format_timestamp(e->end,end);
+		format_timestamp(e->peak_t,peak);
+		if(json)
+		{
+			fprintf(out,"%s\n    { \"condition\": \"%s\", \"start\": \"%s\", \"end\": \"%s\", \"seconds\": %ld, ",
+					x ? "," : "",opt->condition[e->rule],start,end,e->end - e->start);
+			fprintf(out,"\"peak\": %f, \"peakTime\": \"%s\", \"rows\": %ld, \"ongoing\": %s }",
+					e->peak,peak,e->rows,e->ongoing ? "true" : "false");
+			continue;
+		}
+		fprintf(out,"\t\t%s\t%s\t%s\t%ld s\tpeak %f at %s%s\n",opt->condition[e->rule],start,end,
+				e->end - e->start,e->peak,peak,e->ongoing ? "\tongoing" : "");
+	}
+	if(json)
+		fprintf(out," ]");
+}
+
+/*
+	--follow: crunch `path` as it grows, until it's deleted or moved away
+	The watch is set before the file is first read, so nothing added in
+	between is missed. Each wake-up reads from where the last left off;
+	an unfinished last row waits in the input buffer for the rest.
+*/
+int follow(const char *path, struct options *opt)
+{
+	struct input in;
+	struct follow_state f;
+	struct inotify_event event;
+	struct stat st;
+	char changes[4096],detail[24],*row;
+	float v[COLUMNS];
+	double started;
+	ssize_t n,x;
+	int fd,watch,ended,added,r,c;
+
+	fd = open(path,O_RDONLY);
+	if(fd < 0)
+	{
+		fprintf(stderr,"crunch_data: Unable to open %s\n",path);
+		return(1);
+	}
+	watch = inotify_init1(IN_CLOEXEC);
+	if(watch < 0 || inotify_add_watch(watch,path,IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF) < 0)
+	{
+		fprintf(stderr,"crunch_data: Unable to watch %s\n",path);
+		return(1);
+	}
+	open_input(&in,fd);
+	memset(&f,0,sizeof(f));
+	follow_reset(&f);
+
+	ended = 0;
+	for(;;)
+	{
+		/* take in the rows added since the last time */
+		started = trace_now();
+		added = 0;
+		for(;;)
+		{
+			if(split_rows(&in) == 0)
+			{
+				if(read_block(&in) == 0)
+					break;
+				continue;
+			}
+			for(r=0;r<in.rows;r++)
+			{
+				row = in.row[r];
+				if(*row == '\0' || *row == '#' || parse_timestamp(row) < 0)
+					continue;
+				if(f.date_string[0] == '\0')
+					set_date(row,f.date_string);
+				process_row(0,row,&v[0],&v[1],&v[2]);
+				for(c=0;c<COLUMNS;c++)
+				{
+					f.sum[c] += v[c];
+					if(running_median_add(&f.median[c],v[c]) != 0)
+					{
+						fprintf(stderr,"Unable to allocate memory for data storage.\n");
+						exit(1);
+					}
+				}
+				f.rows++;
+				added++;
+			}
+		}
+		in.eof = 0;				/* there's more to come */
+		if(added)
+		{
+			output_follow(&f,opt->json_output);
+			fflush(stdout);
+			if(trace_enabled)
+			{
+				snprintf(detail,sizeof(detail),"%d rows",added);
+				trace_span("crunch","follow update",started,detail);
+			}
+		}
+		if(ended)
+			break;
+
+		/* wait for the file to change */
+		n = read(watch,changes,sizeof(changes));
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			break;
+		for(x=0;x+(ssize_t)sizeof(event)<=n;x+=sizeof(event)+event.len)
+		{
+			memcpy(&event,changes+x,sizeof(event));
+			if(event.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+				ended = 1;		/* after reading what's left */
+		}
+		if(fstat(fd,&st) != 0)
+			break;
+		/* deleted, though it's still open here: only its links change */
+		if(st.st_nlink == 0)
+			ended = 1;
+		/* a file cut short is started over */
+		if(st.st_size < lseek(fd,0,SEEK_CUR))
+		{
+			lseek(fd,0,SEEK_SET);
+			in.length = in.pos = 0;
+			in.skipping = 0;
+			follow_reset(&f);
+		}
+	}
+	for(c=0;c<COLUMNS;c++)
+		running_median_free(&f.median[c]);
+	free(in.buffer);
+	close(watch);
+	close(fd);
+	return(0);
+}
+
+/*
+	Forget the rows taken in so far
+*/
+void follow_reset(struct follow_state *f)
+{
+	int c;
+
+	for(c=0;c<COLUMNS;c++)
+	{
+		running_median_free(&f->median[c]);
+		running_median_init(&f->median[c]);
+	}
+	memset(f->sum,0,sizeof(f->sum));
+	f->rows = 0;
+	f->date_string[0] = '\0';
+}
+
+/*
+	One --follow report: the plain one, with the row count, or a line of
+	JSON, so a reader can take each report as it comes
+*/
+void output_follow(struct follow_state *f, int json)
+{
+	int c;
+
+	if(json)
+	{
+		printf("{ \"%s\": { \"rows\": %ld",f->date_string,f->rows);
+		for(c=0;c<COLUMNS;c++)
+			printf(", \"%s\": { \"mean\": %f, \"median\": %f }",json_names[c],
+					f->sum[c]/f->rows,running_median_get(&f->median[c]));
+		printf(" } }\n");
+		return;
+	}
+	printf("%s\n",f->date_string);
+	printf("\tRows\t%ld\n",f->rows);
+	for(c=0;c<COLUMNS;c++)
+	{
+		printf("\t%s\n",plain_names[c]);
+		printf("\t\tMean\t%f\n",f->sum[c]/f->rows);
+		printf("\t\tMedian\t%f\n",running_median_get(&f->median[c]));
+	}
+}
+
+/*
+	A number for JSON, which has no NaN
+*/
+void print_json_number(FILE *out, double value)
+{
+	if(isnan(value) || isinf(value))
+		fprintf(out,"null");
+	else
+		fprintf(out,"%f",value);
+}
+
 /*
 	Calculate and return the mean (average) of the float array referenced by 'v'
 */
@@ -187,25 +1643,111 @@ float get_mean(float *v, int c)
 }
 
 /*
-	Calculate and return the media (center value) of the float array 'v'
-	The array must be sorted. For an odd number of items, the middle value
-	is returned. For an even number, the two middle values are averaged
-	and that value is returned
+	Calculate and return the median (center value) of the float array 'v'
+	Rather than sorting, the middle element is selected in place, which
+	leaves the array partitioned around index c/2. For an odd number of
+	items, the middle value is returned. For an even number, the two
+	middle values are averaged: the lower one is the largest value in
+	the left partition.
 */
 float get_median(float *v, int c)
 {
-	qsort(v,c,sizeof(float),compare);			/* quick-sort the array */
+	float middle,lower;
+	int x;
+
+	middle = select_kth(v,0,c,c/2);
 	if( c % 2)									/* test odd or even */
-		return(*(v+c/2+1));						/* odd */
-	else
-		return( (*(v+c/2) + *(v+c/2+1)) / 2 );	/* even */
+		return(middle);							/* odd */
+
+	lower = *v;
+	for(x=1;x<c/2;x++)
+		if(*(v+x) > lower)
+			lower = *(v+x);
+	return( (lower + middle) / 2 );				/* even */
 }
 
 /*
-	Comparison method used by qsort(). The order doesn't matter.
+	Mean of the values left after cutting `pct` percent from each end
+	The array must already be partitioned around c/2 by get_median(), so
+	the two cut points are selected within the halves that hold them.
 */
-int compare(const void *a, const void *b)
+float get_trimmed_mean(float *v, int c, float pct)
 {
-	return( *(int *)a - *(int *)b);
+	int k,x;
+	double total = 0.0;
+
+	k = (int)(c * pct / 100);
+	if(k > 0)
+	{
+		select_kth(v,0,c/2,k);
+		select_kth(v,c/2,c,c-k);
+	}
+	for(x=k;x<c-k;x++)
+		total += *(v+x);
+
+	return((float)(total/(c-2*k)));
+}
+
+/*
+	Median absolute deviation: the median of |v - median|
+	The deviations overwrite the array.
+*/
+float get_mad(float *v, int c, float median)
+{
+	int x;
+
+	for(x=0;x<c;x++)
+		*(v+x) = *(v+x) > median ? *(v+x) - median : median - *(v+x);
+
+	return(get_median(v,c));
 }
 
+/*
+	Quickselect: reorder v[lo..hi) so the element of rank `k` sits at
+	v[k], with nothing larger before it and nothing smaller after it.
+	Runs in expected linear time; a median-of-three pivot keeps sorted
+	and reversed input from hitting the quadratic case.
+	`k` must lie within [lo,hi); if k == hi nothing is done.
+*/
+float select_kth(float *v, int lo, int hi, int k)
+{
+	int i,j,mid;
+	float pivot,t;
+
+	if(k >= hi)
+		return(0);
+	hi--;
+	while(lo < hi)
+	{
+		/* order v[lo], v[mid], v[hi] and take the middle one as pivot */
+		mid = lo + (hi - lo)/2;
+		if(*(v+mid) < *(v+lo)) { t = *(v+mid); *(v+mid) = *(v+lo); *(v+lo) = t; }
+		if(*(v+hi) < *(v+lo)) { t = *(v+hi); *(v+hi) = *(v+lo); *(v+lo) = t; }
+		if(*(v+hi) < *(v+mid)) { t = *(v+hi); *(v+hi) = *(v+mid); *(v+mid) = t; }
+		pivot = *(v+mid);
+
+		/* Hoare partition */
+		i = lo;
+		j = hi;
+		while(i <= j)
+		{
+			while(*(v+i) < pivot)
+				i++;
+			while(*(v+j) > pivot)
+				j--;
+			if(i <= j)
+			{
+				t = *(v+i); *(v+i) = *(v+j); *(v+j) = t;
+				i++;
+				j--;
+			}
+		}
+		if(k <= j)
+			hi = j;
+		else if(k >= i)
+			lo = i;
+		else
+			break;		/* v[j+1..i-1] all equal the pivot */
+	}
+	return(*(v+k));
+}
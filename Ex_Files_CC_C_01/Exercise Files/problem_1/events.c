@@ -0,0 +1,140 @@
+/*
+	events
+	See events.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "events.h"
+
+static void end_event(struct event_detector *d, long t, int ongoing);
+static int outage(struct event_detector *d, long t);
+
+/*
+	Parse a `NAME>VALUE[:SECONDS]` or `NAME<VALUE[:SECONDS]` condition,
+	e.g. "wind>20:600". `name` gets NAME, up to EVENT_NAME_SIZE-1 long.
+	Returns 0 on success, -1 if the condition is malformed.
+*/
+int event_parse(const char *spec, char *name, int *above, float *threshold, long *min_seconds)
+{
+	const char *op;
+	char *end;
+
+	op = strpbrk(spec,"<>");
+	if(op == NULL || op == spec || op - spec >= EVENT_NAME_SIZE)
+		return(-1);
+	memcpy(name,spec,op-spec);
+	name[op-spec] = '\0';
+	*above = *op == '>';
+	*threshold = strtof(op+1,&end);
+	if(end == op+1)
+		return(-1);
+	*min_seconds = 0;
+	if(*end == '\0')
+		return(0);
+	if(*end != ':')
+		return(-1);
+	spec = end+1;
+	*min_seconds = strtol(spec,&end,10);
+	if(end == spec || *end != '\0' || *min_seconds < 0)
+		return(-1);
+	return(0);
+}
+
+void event_init(struct event_detector *d, int rule, int column, int above, float threshold,
+		long min_seconds, event_emit emit, void *userdata)
+{
+	memset(d,0,sizeof(*d));
+	d->column = column;
+	d->above = above;
+	d->threshold = threshold;
+	d->min_seconds = min_seconds;
+	d->current.rule = rule;
+	d->emit = emit;
+	d->userdata = userdata;
+}
+
+/*
+	Take in the row `v` at time `t`
+*/
+void event_feed(struct event_detector *d, long t, const float *v)
+{
+	float value;
+	int gap;
+
+	gap = outage(d,t);
+	/* no data isn't the end of the condition, so it stops at the gap */
+	if(d->active && gap)
+		end_event(d,d->current.end + (long)d->interval,0);
+	value = v[d->column];
+	if(!(d->above ? value > d->threshold : value < d->threshold))
+	{
+		if(d->active)
+			end_event(d,t,0);
+		return;
+	}
+	if(!d->active)
+	{
+		d->active = 1;
+		d->current.start = t;
+		d->current.peak = value;
+		d->current.peak_t = t;
+		d->current.rows = 0;
+	}
+	d->current.end = t;
+	d->current.rows++;
+	if(d->above ? value > d->current.peak : value < d->current.peak)
+	{
+		d->current.peak = value;
+		d->current.peak_t = t;
+	}
+}
+
+/*
+	The rows have run out: emit the event under way, if any, its last
+	row standing for an interval as it would have before a gap
+*/
+void event_finish(struct event_detector *d)
+{
+	if(d->active)
+		end_event(d,d->current.end + (long)d->interval,1);
+}
+
+/*
+	Note the gap from the previous row to one at `t`, keeping the usual
+	interval up to date with the gaps that aren't outages
+	Returns 1 if this one is an outage.
+*/
+static int outage(struct event_detector *d, long t)
+{
+	long gap;
+
+	if(!d->seen)
+	{
+		d->seen = 1;
+		d->last_t = t;
+		return(0);
+	}
+	gap = t - d->last_t;
+	d->last_t = t;
+	if(gap <= 0)
+		return(0);
+	if(d->interval == 0)
+	{
+		d->interval = gap;
+		return(0);
+	}
+	if(gap > EVENT_GAP_FACTOR * d->interval)
+		return(1);
+	d->interval += (gap - d->interval) / 8;
+	return(0);
+}
+
+static void end_event(struct event_detector *d, long t, int ongoing)
+{
+	d->active = 0;
+	d->current.end = t;
+	d->current.ongoing = ongoing;
+	if(t - d->current.start >= d->min_seconds)
+		d->emit(&d->current,d->userdata);
+}
@@ -0,0 +1,61 @@
+/*
+	events
+	Finds the stretches of rows over which a value stays above (or
+	below) a threshold, as the rows stream past.
+
+	A detector watches one column. While the condition holds it keeps
+	the first and latest time, the peak and the row count of the
+	current event, and nothing else; the row that breaks the condition
+	ends the event, which is handed to the emit callback if it lasted
+	at least `min_seconds`. An event ends at the time of that row, so
+	its duration covers the interval up to it.
+
+	Each row is taken to stand for the usual interval between rows,
+	smoothed from the gaps that aren't outages. When the gap after an
+	event's last row is more than EVENT_GAP_FACTOR intervals, the data
+	is missing rather than below the threshold, so the event ends one
+	interval after its last row, whatever comes next. Rows are expected
+	in time order and may run across any number of days; an event still
+	going at the end of the rows is emitted by event_finish(), marked as
+	ongoing and ending one interval after its last row.
+*/
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#define EVENT_NAME_SIZE 32
+#define EVENT_GAP_FACTOR 2			/* intervals between rows that make an outage */
+
+struct event {
+	int rule;					/* the detector's, for the caller */
+	long start;					/* seconds, see timestamp.h */
+	long end;
+	float peak;					/* furthest past the threshold */
+	long peak_t;
+	long rows;
+	int ongoing;				/* still holding when the rows ran out */
+};
+
+typedef void (*event_emit)(const struct event *e, void *userdata);
+
+struct event_detector {
+	int column;
+	int above;					/* 1 for value > threshold, 0 for < */
+	float threshold;
+	long min_seconds;
+	int active;					/* an event is under way in `current` */
+	struct event current;
+	int seen;					/* a row has been fed ... */
+	long last_t;				/* ... at this time */
+	double interval;			/* usual seconds between rows, 0 until known */
+	event_emit emit;
+	void *userdata;
+};
+
+int event_parse(const char *spec, char *name, int *above, float *threshold, long *min_seconds);
+void event_init(struct event_detector *d, int rule, int column, int above, float threshold,
+		long min_seconds, event_emit emit, void *userdata);
+void event_feed(struct event_detector *d, long t, const float *v);
+void event_finish(struct event_detector *d);
+
+#endif
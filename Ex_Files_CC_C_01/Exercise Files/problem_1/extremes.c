@@ -0,0 +1,142 @@
+/*
+	extremes
+	See extremes.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "extremes.h"
+
+static int beyond(const struct extremes *e, const struct extreme *a, const struct extreme *b);
+static void sift_down(struct extremes *e, int i);
+static int compare_largest(const void *a, const void *b);
+static int compare_smallest(const void *a, const void *b);
+
+/*
+	Returns 0 on success, -1 if the heap can't be allocated
+*/
+int extremes_init(struct extremes *e, int k, int largest)
+{
+	e->largest = largest;
+	e->k = k;
+	e->count = 0;
+	e->item = (struct extreme *)malloc(k*sizeof(struct extreme));
+	return(e->item ? 0 : -1);
+}
+
+/*
+	Keep `v`, seen at `t`, if it's among the k most extreme so far
+*/
+void extremes_add(struct extremes *e, float v, long t)
+{
+	struct extreme item,swap;
+	int i,parent;
+
+	if(v != v)
+		return;
+	item.v = v;
+	item.t = t;
+	if(e->count == e->k)
+	{
+		/* the root is the one to beat */
+		if(!beyond(e,&item,&e->item[0]))
+			return;
+		e->item[0] = item;
+		sift_down(e,0);
+		return;
+	}
+	i = e->count++;
+	e->item[i] = item;
+	while(i > 0)
+	{
+		parent = (i-1) / 2;
+		if(!beyond(e,&e->item[parent],&e->item[i]))
+			break;
+		swap = e->item[i];
+		e->item[i] = e->item[parent];
+		e->item[parent] = swap;
+		i = parent;
+	}
+}
+
+/*
+	Keep the most extreme of both
+*/
+void extremes_merge(struct extremes *into, const struct extremes *from)
+{
+	int i;
+
+	for(i=0;i<from->count;i++)
+		extremes_add(into,from->item[i].v,from->item[i].t);
+}
+
+/*
+	Copy the values kept to `out`, most extreme first, earliest first
+	among equals. Returns how many there are.
+*/
+int extremes_sorted(const struct extremes *e, struct extreme *out)
+{
+	memcpy(out,e->item,e->count*sizeof(struct extreme));
+	qsort(out,e->count,sizeof(struct extreme),e->largest ? compare_largest : compare_smallest);
+	return(e->count);
+}
+
+void extremes_free(struct extremes *e)
+{
+	free(e->item);
+	e->item = NULL;
+	e->count = 0;
+}
+
+/*
+	Whether `a` is more extreme than `b`; of equal values, the earlier
+*/
+static int beyond(const struct extremes *e, const struct extreme *a, const struct extreme *b)
+{
+	if(a->v == b->v)
+		return(a->t < b->t);
+	return(e->largest ? a->v > b->v : a->v < b->v);
+}
+
+/*
+	Move item i down until the heap is in order again
+*/
+static void sift_down(struct extremes *e, int i)
+{
+	struct extreme swap;
+	int child;
+
+	for(;;)
+	{
+		child = 2*i + 1;
+		if(child >= e->count)
+			break;
+		/* the less extreme child */
+		if(child+1 < e->count && beyond(e,&e->item[child],&e->item[child+1]))
+			child++;
+		if(!beyond(e,&e->item[i],&e->item[child]))
+			break;
+		swap = e->item[i];
+		e->item[i] = e->item[child];
+		e->item[child] = swap;
+		i = child;
+	}
+}
+
+static int compare_largest(const void *a, const void *b)
+{
+	const struct extreme *x = a, *y = b;
+
+	if(x->v != y->v)
+		return(x->v < y->v ? 1 : -1);
+	return( (x->t > y->t) - (x->t < y->t) );
+}
+
+static int compare_smallest(const void *a, const void *b)
+{
+	const struct extreme *x = a, *y = b;
+
+	if(x->v != y->v)
+		return(x->v > y->v ? 1 : -1);
+	return( (x->t > y->t) - (x->t < y->t) );
+}
@@ -0,0 +1,37 @@
+/*
+	extremes
+	The K largest (or smallest) values seen and when they were seen,
+	kept while the values stream past.
+
+	The values kept form a binary heap with the least extreme of them
+	at the root, so a value that doesn't make the cut costs one
+	comparison and one that does costs log K swaps; nothing else is
+	stored. Merging two is adding the values of one to the other, which
+	combines the results of several threads, files or days exactly.
+	Among equal values the earliest is kept. NaNs are ignored.
+*/
+
+#ifndef EXTREMES_H
+#define EXTREMES_H
+
+#define EXTREMES_MAX 10000
+
+struct extreme {
+	float v;
+	long t;
+};
+
+struct extremes {
+	int largest;				/* 1 to keep the largest, 0 the smallest */
+	int k;
+	int count;
+	struct extreme *item;		/* the heap, k long */
+};
+
+int extremes_init(struct extremes *e, int k, int largest);
+void extremes_add(struct extremes *e, float v, long t);
+void extremes_merge(struct extremes *into, const struct extremes *from);
+int extremes_sorted(const struct extremes *e, struct extreme *out);
+void extremes_free(struct extremes *e);
+
+#endif
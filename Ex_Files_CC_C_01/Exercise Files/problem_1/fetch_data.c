@@ -4,6 +4,18 @@
 
 	This code reads raw data from three websites. Current data is read,
 	unless a specific date is used as an argument, format YYYYMMDD.
+	Given two dates, every day from the first to the second is read in
+	turn (a backfill). The page buffers are then recycled from day to day
+	through a buffer pool, so a long run settles into reusing the same
+	few buffers instead of allocating them again. The same goes for the
+	rest of a day: each thread keeps its curl handles and transfers for
+	the whole run (see struct fetcher), and the page tables and output
+	streams are kept from day to day, so once the first day is done the
+	next ones allocate nothing.
+
+	Page addresses are built from a template (--template), by default
+	{base}/{station}/{year}/{date}/{channel}, so the same code can read
+	other stations, other channels or a local mirror of the site.
 
 	Data is fetched by using the curl library; compile with -lcurl
 		http://curl.haxx.se/libcurl/
@@ -14,6 +26,65 @@
 
 	2015_02_03 09:02:34 38.86  30.07   3.00
 	Date, Time, Air Temperature, Barometric Pressure, Wind Speed
+
+	The pages are fetched concurrently. Each page is requested from the
+	first mirror (see --mirror) with the --base host last in line; a
+	failed transfer moves on to the next one. A transfer that takes longer
+	than the 95th percentile of the recent transfers is hedged: a
+	duplicate request goes to the next mirror and whichever finishes first
+	is used.
+
+	Several stations can be fetched at once (--station DM,XY). Their
+	pages share the same pool of transfers. The tables are either merged
+	into one, in time order with the station id as a last column, or
+	written to one file per station with --split.
+
+	With --start and --end only part of the day is fetched. The pages
+	have fixed-width lines, so the byte offset of a time of day can be
+	estimated from the first few lines. A few small Range requests
+	confirm the estimate (see locate_time()), then only that byte range
+	of each page is requested. Rows outside the window are still
+	dropped, in case a server ignores the Range header.
+
+	With --save-raw the pages are also stored exactly as served, in the
+	same {station}/{year}/{date}/{channel} layout as the site, so the
+	directory can later serve as a file:// mirror. Each transfer streams
+	to disk from the curl write callback (see raw_write()) as it arrives,
+	so nothing is downloaded twice. With --start and --end only the
+	window's byte range is served, so it is saved under
+	CHANNEL.range-FIRST-LAST instead: a mirror never hands out part of
+	a day as the whole of it.
+
+	With --resample the merged rows are put onto a uniform time grid
+	(see resample.h) and the gap statistics are reported on stderr.
+
+	With --lookahead N a backfill downloads up to N days ahead of the
+	day being written, each on its own thread, so the network is busy
+	while a day is merged and written. Days finish in any order; they
+	wait in a reorder buffer and are always written in date order.
+
+	With --shm, and standard output a pipe, the rows are handed to
+	crunch_data through a shared memory ring (see shm_ring.h) instead of
+	as text. If nothing claims the ring the text is written as usual.
+
+	With --trace FILE every transfer, download, merge and write is
+	recorded with its thread and time, and written to FILE at exit in
+	Chrome trace format (see trace.h).
+
+	The time taken by every transfer and every day's download is kept in
+	an HDR histogram (see hdr_hist.h); --latency-stats reports the tail
+	percentiles on stderr. Each lookahead thread keeps its own day
+	histogram and merges it into the run's when it finishes.
+
+	With --record FILE every response is also kept in FILE: headers, body
+	and when each piece of the body arrived (see fixture.h). --replay
+	FILE serves the same responses back through the same write callback
+	without touching the network, as fast as they can be handed over;
+	--replay-timed FILE keeps to the times they first arrived. Either
+	way the pages are merged and written exactly as before, so a run can
+	be repeated offline, e.g. to measure it.
+
+	Compile with: cc -o fetch_data fetch_data.c resample.c timestamp.c shm_ring.c trace.c hdr_hist.c fixture.c -lcurl -lz -lpthread
 */
 
 #include <stdio.h>
@@ -21,241 +92,2286 @@
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <curl/curl.h>
+#include <zlib.h>
+#include <pthread.h>
+#include "resample.h"
+#include "timestamp.h"
+#include "shm_ring.h"
+#include "trace.h"
+#include "hdr_hist.h"
+#include "fixture.h"
 
 #define VALUE_READ_OFFSET 19
 #define DATE_STRING_SEPARATOR '_'
+#define DEFAULT_TEMPLATE "{base}/{station}/{year}/{date}/{channel}"
+#define DEFAULT_BASE "http://lpo.dt.navy.mil/data"
+#define DEFAULT_STATION "DM"
+#define DEFAULT_CHANNELS "Air_Temp,Barometric_Press,Wind_Speed"
+#define MAX_MIRRORS 8
+#define MAX_CHANNELS 8
+#define MAX_STATIONS 16
+#define URL_SIZE 512
+#define HEDGE_MIN_SAMPLES 8		/* fewer than this and hedge_ms is used */
+#define HEDGE_WINDOW 256		/* transfers in each half of the hedging window */
+#define POLL_MS 50
+#define PROBE_SIZE 2048			/* bytes read by each time window probe */
+#define MAX_PROBES 6			/* probes to find one end of the window */
+#define PROBE_MARGIN 2			/* extra lines fetched each side of the window */
+#define RAW_TEMPLATE "{base}/{station}/{year}/{date}/{channel}"
+#define RAW_BUFFER_SIZE (1024*1024)	/* bytes per write() of a saved page */
+#define RAW_ALIGN 4096
+#define POOL_SLOTS 64			/* idle buffers kept by the pool */
+#define MAX_LOOKAHEAD 16
+#define MAX_TRANSFERS 256
 
 struct web_data {
 	char *buffer;
 	size_t size;
+	size_t capacity;		/* bytes allocated for `buffer` */
+};
+
+/* page buffers kept for reuse, see pool_get() */
+struct buffer_pool {
+	pthread_mutex_t lock;	/* shared by the lookahead threads */
+	char *idle[POOL_SLOTS];
+	size_t idle_capacity[POOL_SLOTS];
+	int idle_count;
+	size_t hint;			/* capacity for a new buffer, from recent page sizes */
+	long hits;				/* buffers handed out from the pool ... */
+	long misses;			/* ... or newly allocated */
+	long grows;				/* buffers enlarged */
+	size_t bytes;			/* allocated for buffers, idle or not */
+	size_t peak;
+};
+
+/* how and where pages are fetched */
+struct fetch_config {
+	const char *template;				/* see build_address() */
+	const char *mirror[MAX_MIRRORS];	/* base URLs, in order of preference */
+	int mirrors;
+	long timeout;			/* whole transfer, seconds, 0 for no limit */
+	long connect_timeout;	/* seconds */
+	long low_speed_limit;	/* abort when slower than this many bytes/s ... */
+	long low_speed_time;	/* ... for this many seconds */
+	long hedge_ms;			/* hedge delay until enough latencies are seen, 0 = never */
+	int max_transfers;		/* transfers in flight at once */
+	const char *raw_dir;	/* save pages as served under here, or NULL */
+	int raw_compress;		/* gzip them */
+	struct buffer_pool *pool;	/* page buffers come from here */
+	struct fixture *record;	/* keep the responses here, or NULL */
+	struct fixture *replay;	/* serve them from here instead, or NULL */
+	int replay_timed;		/* at the pace they were recorded */
+};
+
+/* a page being saved as it streams in */
+struct raw_file {
+	int fd;
+	char *buffer;			/* RAW_ALIGN aligned, RAW_BUFFER_SIZE bytes */
+	size_t used;
+	int compress;
+	z_stream z;
+	int deflating;			/* `z` is set up, and reset for each page */
+	char path[FILENAME_MAX];	/* final name */
+	char temp[FILENAME_MAX];	/* written here until the transfer wins */
+};
+
+/* resampling requested on the command line */
+struct resample_options {
+	int enabled;
+	long step;
+	long max_gap;
+	int mode;
+};
+
+/* where and how a station's table is written */
+struct table_output {
+	FILE *fp;
+	int channels;
+	const char *tag;		/* station id added to each row, or NULL */
+	long start;				/* time of day window, seconds: rows in */
+	long end;				/* [start,end) are written, end < 0 for all */
+	struct shm_ring *ring;	/* rows go here instead of `fp`, or NULL */
+};
+
+/* how long things took, for the hedging percentile and --latency-stats */
+struct latency_log {
+	pthread_mutex_t lock;
+	struct hdr_hist transfers;	/* successful page transfers, probes left out */
+	struct hdr_hist days;		/* whole days, set_window() probes included */
+	struct hdr_hist recent[2];	/* the same transfers, the last 256 to 512 */
+	struct hdr_hist window;		/* the two merged */
+	int filling;				/* recent[filling] takes the new ones */
+	long hedge_us;				/* p95 of `window`, 0 while it's too small */
+};
+
+struct transfer;
+
+/* one page to fetch, from whichever mirror delivers it first */
+struct page {
+	const char *station;		/* template fields for the address */
+	const char *year;
+	const char *date;
+	const char *channel;
+	struct web_data data;		/* filled in once the page is done */
+	int done;
+	int failed;					/* every mirror failed; `data` is empty */
+	int quiet;					/* don't report failures (probes) */
+	char range[48];				/* byte range to request, "" for all */
+	int attempts;				/* transfers started, picks the mirror */
+	int failures;
+	int hedged;
+	struct transfer *xfer[2];	/* the first request and its hedge */
+};
+
+/* a single request for a page */
+struct transfer {
+	CURL *curl;
+	struct page *page;
+	struct web_data data;
+	struct raw_file *raw;		/* copy on disk, or NULL */
+	struct raw_file *raw_kept;	/* what `raw` points to, kept for the next page */
+	struct buffer_pool *pool;	/* `data` comes from and returns to here */
+	char url[URL_SIZE];
+	double started;
+	const char *outcome;		/* for the trace: delivered, failed or abandoned */
+	struct fixture *record;		/* --record: keep the response here */
+	struct web_data headers;
+	struct fixture_chunk *chunk;	/* when the body arrived */
+	int chunks;
+	int chunk_capacity;
+	int replaying;				/* --replay: served from the recording */
+	struct fixture_response *replay;	/* NULL if it wasn't recorded */
+	int replay_next;			/* chunks handed over */
+	size_t replay_offset;
+	struct transfer *next;		/* in the fetcher's idle list */
+};
+
+/*
+	A thread's multi handle and transfers, kept for the whole run. A
+	finished transfer goes back on the idle list with its easy handle,
+	which is reset for its next request, so the connections stay open
+	and no day after the first has to allocate any.
+*/
+struct fetcher {
+	CURLM *multi;
+	struct transfer *idle;
+	long reused;				/* transfers handed out again ... */
+	long created;				/* ... or newly made */
+};
+
+/* settings shared by every day of a run */
+struct run {
+	struct fetch_config cfg;
+	struct latency_log latencies;
+	struct buffer_pool pool;
+	struct resample_options ro;
+	char *channel[MAX_CHANNELS];
+	int channels;
+	char *station[MAX_STATIONS];
+	int stations;
+	char *split_dir;
+	long window_start;
+	long window_end;
+	int lookahead;			/* days downloaded ahead, 0 for one at a time */
+	struct shm_ring *ring;	/* claimed by crunch_data, or NULL */
+	struct fetcher fetcher;	/* the main thread's, with the run's totals */
+	FILE *table[MAX_STATIONS];	/* each station's --split file or memory stream */
+	char *table_buffer[MAX_STATIONS];	/* ... and the memory stream's text */
+	size_t table_size[MAX_STATIONS];
+};
+
+/* the pages of one day, for every station and channel */
+struct day {
+	char year[5];
+	char date[11];			/* YYYY_MM_DD */
+	struct page *pages;		/* station by station, in channel order */
+};
+
+/* days downloading ahead of output, see run_lookahead() */
+struct reorder {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;	/* a day has finished downloading */
+	pthread_cond_t space;	/* a day has been written, its slot is free */
+	struct run *run;
+	struct day slot[MAX_LOOKAHEAD+1];	/* day d lives in slot d % slots */
+	int done[MAX_LOOKAHEAD+1];
+	int slots;
+	long first;				/* midnight of day 0 */
+	int days;
+	int next_fetch;			/* next day for a thread to download */
+	int next_output;		/* next day to write */
 };
 
-void set_address_date(char *address, char *year, char *date);
-long fetch_web_data(struct web_data *chunk, char *address);
+int build_address(char *address, size_t size, const char *template, const char *base,
+		const char *station, const char *year, const char *date, const char *channel);
+int split_list(char *list, char **item, int max);
+void fetcher_init(struct fetcher *f);
+void fetcher_free(struct fetcher *f);
+void fetch_web_pages(struct fetcher *f, struct page *pages, int n, struct fetch_config *cfg,
+		struct latency_log *log);
+static void start_transfer(struct fetcher *f, struct page *page, struct fetch_config *cfg);
+static void finish_transfer(struct fetcher *f, struct transfer *x);
+static int end_transfer(struct fetcher *f, struct transfer *x, int result, struct fetch_config *cfg,
+		struct latency_log *log, int *active);
+static int replay_transfers(struct fetcher *f, struct page *pages, int n, struct fetch_config *cfg,
+		struct latency_log *log, int *active, long *wait);
+static void record_transfer(struct transfer *x, int result);
+static size_t header_mem(char *ptr, size_t size, size_t nmemb, void *userdata);
+static void record_latency(struct latency_log *log, double ms);
+static double hedge_delay(struct latency_log *log, struct fetch_config *cfg);
+static double now_ms(void);
 static size_t write_mem(void *contents, size_t size, size_t n, void *userp);
-int write_line(char *text,int offset);
+static struct raw_file *raw_open(struct fetch_config *cfg, struct page *page, struct raw_file *raw);
+static void raw_write(struct raw_file *raw, const char *data, size_t size);
+static void raw_flush(struct raw_file *raw);
+static void raw_close(struct raw_file *raw, int keep);
+static void make_parent_dirs(char *path);
+int set_window(struct fetcher *f, struct page *pages, int channels, long start, long end,
+		struct fetch_config *cfg, struct latency_log *log);
+static int locate_window(struct fetcher *f, struct page *pages, int channels, long start, long end,
+		struct fetch_config *cfg, struct latency_log *log);
+static long locate_time(struct fetcher *f, struct page *model, long target, long line_size,
+		double interval, struct fetch_config *cfg, struct latency_log *log);
+static int probe_page(struct fetcher *f, struct page *model, long offset, struct page *probe,
+		struct fetch_config *cfg, struct latency_log *log);
+long parse_time_of_day(const char *text);
+long parse_date(const char *text);
+long option_number(int argc, char *argv[], int *a, long min, long max, const char *unit);
+int parse_low_speed(const char *text, struct fetch_config *cfg);
+void setup_day(struct run *run, struct day *day, long midnight);
+void download_day(struct run *run, struct fetcher *f, struct day *day, struct hdr_hist *days);
+int output_day(struct run *run, struct day *day);
+void release_day(struct run *run, struct day *day);
+void free_day(struct day *day);
+void close_tables(struct run *run);
+int run_lookahead(struct run *run, long first, int days);
+static void *lookahead_thread(void *arg);
+void pool_get(struct buffer_pool *pool, struct web_data *data);
+void pool_grow(struct buffer_pool *pool, struct web_data *data, size_t needed);
+void pool_put(struct buffer_pool *pool, struct web_data *data);
+void pool_drain(struct buffer_pool *pool);
+int page_error(struct page *pages, int channels);
+void write_station(struct page *pages, struct table_output *out, struct resample_options *ro);
+void merge_tables(char **table, size_t *size, int n, FILE *fp);
+int write_line(char *text,int offset,FILE *fp);
+int line_length(char *text);
+void write_grid(const long *t, float * const *v, int n, void *userdata);
+void write_ring_row(struct table_output *out, long t, const float *v);
+int open_ring(struct run *run, struct shm_ring *ring);
 void show_help(void);
 
 int main(int argc, char *argv[])
 {
-	struct web_data air_temp,barometric_press,wind_speed;
-	int a,b,output,written;
-	long bytes_read;
+	int a,dates,pool_stats,latency_stats,failed,shm,hedge_set;
+	struct run run;
+	struct fixture recording,replaying;
+	struct shm_ring ring;
+	struct day day;
+	char *date_arg[2];
+	char channel_list[] = DEFAULT_CHANNELS;
+	char station_list[] = DEFAULT_STATION;
+	char today[TIMESTAMP_SIZE];
+	const char *base;
+	long first,last,midnight;
 	time_t tictoc;
 	struct tm *date;
-	char year[5],datestring[11];
-	/* check set_address_date() for offsets used in these addresses */
-	char air_temp_address[] = "http://lpo.dt.navy.mil/data/DM/2014/2014_01_01/Air_Temp";
-	char barometric_press_address[] = "http://lpo.dt.navy.mil/data/DM/2014/2014_01_01/Barometric_Press";
-	char wind_speed_address[] = "http://lpo.dt.navy.mil/data/DM/2014/2014_01_01/Wind_Speed";
 
 	/* Read command line parameters */
-	if(argc <= 1)
+	memset(&run,0,sizeof(run));
+	dates = 0;
+	pool_stats = 0;
+	latency_stats = 0;
+	shm = 0;
+	hedge_set = 0;
+	run.window_start = 0;
+	run.window_end = -1;
+	run.cfg.template = DEFAULT_TEMPLATE;
+	run.cfg.pool = &run.pool;
+	base = DEFAULT_BASE;
+	run.stations = split_list(station_list,run.station,MAX_STATIONS);
+	run.channels = split_list(channel_list,run.channel,MAX_CHANNELS);
+	run.cfg.timeout = 300;
+	run.cfg.connect_timeout = 30;
+	run.cfg.low_speed_limit = 1;
+	run.cfg.low_speed_time = 60;
+	run.cfg.hedge_ms = 5000;
+	run.cfg.max_transfers = 16;
+	pthread_mutex_init(&run.pool.lock,NULL);
+	pthread_mutex_init(&run.latencies.lock,NULL);
+	hdr_init(&run.latencies.transfers);
+	hdr_init(&run.latencies.days);
+	hdr_init(&run.latencies.recent[0]);
+	hdr_init(&run.latencies.recent[1]);
+	for(a=1;a<argc;a++)
 	{
-			/* no arguments specified, use today's date */
-		time(&tictoc);
-		date = localtime(&tictoc);
-		sprintf(year,"%4d",date->tm_year+1900);
-		sprintf(datestring,"%4d_%02d_%02d",date->tm_year+1900,date->tm_mon+1,date->tm_mday);
-	}
-	else
-	{
-		if(strcmp(argv[1],"--help")==0)
+		if(strcmp(argv[a],"--help")==0)
 		{
 			show_help();
 			exit(0);
 		}
-		else		/* a date is specified */
+		else if(strcmp(argv[a],"--mirror")==0 && a+1<argc)
+		{
+			if(run.cfg.mirrors == MAX_MIRRORS-1)
+			{
+				fprintf(stderr,"Too many mirrors, %d at most\n",MAX_MIRRORS-1);
+				exit(1);
+			}
+			run.cfg.mirror[run.cfg.mirrors++] = argv[++a];
+		}
+		else if(strcmp(argv[a],"--base")==0 && a+1<argc)
+			base = argv[++a];
+		else if(strcmp(argv[a],"--template")==0 && a+1<argc)
+			run.cfg.template = argv[++a];
+		else if(strcmp(argv[a],"--station")==0 && a+1<argc)
+		{
+			run.stations = split_list(argv[++a],run.station,MAX_STATIONS);
+			if(run.stations == 0)
+			{
+				fprintf(stderr,"Improper station list: Use ID[,ID...], %d at most\n",MAX_STATIONS);
+				exit(1);
+			}
+		}
+		else if(strcmp(argv[a],"--start")==0 && a+1<argc)
+		{
+			if((run.window_start = parse_time_of_day(argv[++a])) < 0)
+			{
+				fprintf(stderr,"Improper time format: Use HH:MM\n");
+				exit(1);
+			}
+		}
+		else if(strcmp(argv[a],"--end")==0 && a+1<argc)
+		{
+			if((run.window_end = parse_time_of_day(argv[++a])) < 0)
+			{
+				fprintf(stderr,"Improper time format: Use HH:MM\n");
+				exit(1);
+			}
+		}
+		else if(strcmp(argv[a],"--save-raw")==0 && a+1<argc)
+			run.cfg.raw_dir = argv[++a];
+		else if(strcmp(argv[a],"--compress")==0)
+			run.cfg.raw_compress = 1;
+		else if(strcmp(argv[a],"--split")==0 && a+1<argc)
+			run.split_dir = argv[++a];
+		else if(strcmp(argv[a],"--pool-stats")==0)
+			pool_stats = 1;
+		else if(strcmp(argv[a],"--latency-stats")==0)
+			latency_stats = 1;
+		else if(strcmp(argv[a],"--shm")==0)
+			shm = 1;
+		else if(strcmp(argv[a],"--trace")==0 && a+1<argc)
+		{
+			if(trace_open(argv[++a]) != 0)
+			{
+				fprintf(stderr,"Unable to start the trace\n");
+				exit(1);
+			}
+			trace_thread_name("main");
+		}
+		else if(strcmp(argv[a],"--record")==0 && a+1<argc)
+		{
+			if(fixture_record(&recording,argv[++a]) != 0)
+			{
+				fprintf(stderr,"Unable to record to %s\n",argv[a]);
+				exit(1);
+			}
+			run.cfg.record = &recording;
+		}
+		else if((strcmp(argv[a],"--replay")==0 || strcmp(argv[a],"--replay-timed")==0) && a+1<argc)
+		{
+			run.cfg.replay_timed = strcmp(argv[a],"--replay-timed") == 0;
+			if(fixture_load(&replaying,argv[++a]) != 0)
+			{
+				fprintf(stderr,"Unable to replay %s\n",argv[a]);
+				exit(1);
+			}
+			run.cfg.replay = &replaying;
+		}
+		else if(strcmp(argv[a],"--lookahead")==0)
+			run.lookahead = (int)option_number(argc,argv,&a,0,MAX_LOOKAHEAD,"days");
+		else if(strcmp(argv[a],"--max-transfers")==0)
+			run.cfg.max_transfers = (int)option_number(argc,argv,&a,1,MAX_TRANSFERS,"transfers");
+		else if(strcmp(argv[a],"--channels")==0 && a+1<argc)
+		{
+			run.channels = split_list(argv[++a],run.channel,MAX_CHANNELS);
+			if(run.channels == 0)
+			{
+				fprintf(stderr,"Improper channel list: Use NAME[,NAME...], %d at most\n",MAX_CHANNELS);
+				exit(1);
+			}
+		}
+		else if(strcmp(argv[a],"--timeout")==0)
+			run.cfg.timeout = option_number(argc,argv,&a,0,TIMESTAMP_DAY,"seconds");
+		else if(strcmp(argv[a],"--connect-timeout")==0)
+			run.cfg.connect_timeout = option_number(argc,argv,&a,0,TIMESTAMP_DAY,"seconds");
+		else if(strcmp(argv[a],"--hedge")==0)
+		{
+			run.cfg.hedge_ms = option_number(argc,argv,&a,0,TIMESTAMP_DAY*1000,"milliseconds");
+			hedge_set = 1;
+		}
+		else if(strcmp(argv[a],"--low-speed")==0)
 		{
-			for(a=0;a<8;a++)
+			if(a+1 == argc || parse_low_speed(argv[++a],&run.cfg) != 0)
 			{
-				if(!isdigit(argv[1][a]))
-				{
-					fprintf(stderr,"Improper date format: Use YYYYMMDD\n");
-					exit(1);
-				}
+				fprintf(stderr,"Improper low speed format: Use BYTES:SECONDS\n");
+				exit(1);
 			}
-			/* extract year from date */
-			for(a=0;a<4;a++)
-				year[a] = argv[1][a];
-			year[a] = '\0';
-			/* manipulate date string into web page address format: YYYY_MM_DD */
-			for(a=0,b=0;a<10;a++,b++)
+		}
+		else if(strcmp(argv[a],"--resample")==0 && a+1<argc)
+		{
+			if(resample_parse(argv[++a],&run.ro.step,&run.ro.mode,&run.ro.max_gap) != 0)
 			{
-				if(a==4 || a==7)
-					datestring[a++] = DATE_STRING_SEPARATOR;
-				datestring[a] = argv[1][b];
+				fprintf(stderr,"Improper resample format: Use STEP[:linear|last[:MAXGAP]]\n");
+				exit(1);
 			}
-			datestring[a] = '\0';
+			run.ro.enabled = 1;
+		}
+		else if(argv[a][0] == '-')
+		{
+			fprintf(stderr,"Unknown option: %s\n",argv[a]);
+			exit(1);
+		}
+		else if(dates == 2)
+		{
+			fprintf(stderr,"At most two dates: the first and last day to fetch\n");
+			exit(1);
 		}
+		else
+			date_arg[dates++] = argv[a];
+	}
+	/* the base is always the last resort */
+	run.cfg.mirror[run.cfg.mirrors++] = base;
+	/* a hedge goes to the next mirror, so with only the base there is none */
+	if(run.cfg.mirrors == 1 && run.cfg.hedge_ms > 0)
+	{
+		if(hedge_set)
+			fprintf(stderr,"No mirror to hedge to: --hedge needs a --mirror, hedging is off\n");
+		run.cfg.hedge_ms = 0;
+	}
+	if(run.window_end < 0 && run.window_start > 0)
+		run.window_end = TIMESTAMP_DAY;
+	if(run.window_end >= 0 && run.window_end <= run.window_start)
+	{
+		fprintf(stderr,"The --end time must be later than --start\n");
+		exit(1);
 	}
-	/* patch the web page addresses to reflect the desired date */
-	set_address_date(air_temp_address,year,datestring);
-	set_address_date(barometric_press_address,year,datestring);
-	set_address_date(wind_speed_address,year,datestring);
 
-	/*
-		Read the web pages and store the data. The value for `bytes_read`
-		is the same for each page, so it's stored only once */
-	bytes_read = fetch_web_data(&air_temp,air_temp_address);
-	/*
-		Check for error on the first call. All three pages would be
-		down together */
-	if( strstr(air_temp.buffer,"error.html")!=NULL)
+	if(dates == 0)
+	{
+			/* no date specified, use today's date */
+		time(&tictoc);
+		date = localtime(&tictoc);
+		snprintf(today,sizeof(today),"%04d%02d%02d",
+				(date->tm_year+1900)%10000,(date->tm_mon+1)%100,date->tm_mday%100);
+		date_arg[dates++] = today;
+	}
+	first = parse_date(date_arg[0]);
+	last = dates == 2 ? parse_date(date_arg[1]) : first;
+	if(last < first)
 	{
-		fprintf(stderr,"Web page error reported.\nConfirm correct date.\n");
+		fprintf(stderr,"The last date comes before the first\n");
 		exit(1);
 	}
-	fetch_web_data(&barometric_press,barometric_press_address);
-	fetch_web_data(&wind_speed,wind_speed_address);
 
-	/* output data in 3 column format */
-	/*
-		`output` keeps track of text output, which balances
-		`bytes_read` for input. Because `write_line` for the
-		`air_temp.buffer` outputs the same length as input, the
-		numbers track equally, fully dumping all the data in the
-		desired format. */
-	output = 0;
-	while(output < bytes_read)
+	/* offer crunch_data the rows in shared memory; text if it won't have them */
+	if(shm && open_ring(&run,&ring) == 0)
+		run.ring = &ring;
+
+	/* Read and output the days in turn */
+	curl_global_init(CURL_GLOBAL_ALL);
+	fetcher_init(&run.fetcher);
+	failed = 0;
+	if(run.lookahead > 0 && last > first)
+		failed = run_lookahead(&run,first,(int)((last-first)/TIMESTAMP_DAY)+1);
+	else
 	{
-		written = write_line(air_temp.buffer+output,0);
-		putchar(' ');
-		write_line(barometric_press.buffer+output,VALUE_READ_OFFSET);
-		putchar(' ');
-		write_line(wind_speed.buffer+output,VALUE_READ_OFFSET);
-		putchar('\n');
-		output += written;
+		day.pages = NULL;
+		for(midnight=first;midnight<=last;midnight+=TIMESTAMP_DAY)
+		{
+			setup_day(&run,&day,midnight);
+			download_day(&run,&run.fetcher,&day,&run.latencies.days);
+			if(output_day(&run,&day) != 0)
+				failed++;
+			release_day(&run,&day);
+		}
+		free_day(&day);
 	}
+	close_tables(&run);
 
-	/* release memory chunks */
-	if(air_temp.buffer) free(air_temp.buffer);
-	if(barometric_press.buffer) free(barometric_press.buffer);
-	if(wind_speed.buffer) free(wind_speed.buffer);
+	if(pool_stats)
+	{
+		fprintf(stderr,"Buffer pool: %ld hits, %ld misses, %ld grows, peak %lu bytes\n",
+				run.pool.hits,run.pool.misses,run.pool.grows,(unsigned long)run.pool.peak);
+		fprintf(stderr,"Transfers: %ld reused, %ld created\n",
+				run.fetcher.reused,run.fetcher.created);
+	}
+	fetcher_free(&run.fetcher);
+	if(latency_stats)
+	{
+		hdr_report(stderr,&run.latencies.transfers,"Transfers",0);
+		hdr_report(stderr,&run.latencies.days,"Days",0);
+	}
+	pool_drain(&run.pool);
+	if(run.ring)
+		shm_ring_close(run.ring);
+	if(run.cfg.record)
+		fixture_close(run.cfg.record);
+	if(run.cfg.replay)
+		fixture_close(run.cfg.replay);
 
+	/* a backfill carries on past a bad day, but says so at the end */
+	if(failed)
+	{
+		fprintf(stderr,"Confirm correct date.\n");
+		exit(1);
+	}
 	return(0);
 }
 
 /*
-   Assign the proper date to the web page address string
+   Convert a YYYYMMDD argument to the time of that day's midnight
 */
-void set_address_date(char *address, char *year, char *date)
+long parse_date(const char *text)
 {
-#define YEAR_OFFSET 31
-#define DATE_OFFSET 36
-#define YEAR_SIZE 4
-#define DATE_SIZE 10
+	char stamp[TIMESTAMP_SIZE];
+	long t;
+	int a;
 
-	int x;
-	for(x=0;x<YEAR_SIZE;x++)
-		*(address+YEAR_OFFSET+x) = *(year+x);
-	for(x=0;x<DATE_SIZE;x++)
-		*(address+DATE_OFFSET+x) = *(date+x);
+	for(a=0;a<8;a++)
+	{
+		if(!isdigit(text[a]))
+		{
+			fprintf(stderr,"Improper date format: Use YYYYMMDD\n");
+			exit(1);
+		}
+	}
+	/* manipulate date string into timestamp format: YYYY_MM_DD 00:00:00 */
+	snprintf(stamp,sizeof(stamp),"%.4s%c%.2s%c%.2s 00:00:00",
+			text,DATE_STRING_SEPARATOR,text+4,DATE_STRING_SEPARATOR,text+6);
+	t = parse_timestamp(stamp);
+	if(t < 0)
+	{
+		fprintf(stderr,"Improper date format: Use YYYYMMDD\n");
+		exit(1);
+	}
+	return(t);
 }
 
 /*
-	Fill the web data buffer with text read from the web page
- */
-long fetch_web_data(struct web_data *chunk, char *address)
+   The number after option argv[*a], which is stepped past; one that's
+   missing or not from `min` to `max` ends the program
+*/
+long option_number(int argc, char *argv[], int *a, long min, long max, const char *unit)
 {
-	CURL *curl;
-	CURLcode res;
+	const char *option;
+	char *end;
+	long value;
 
-	chunk->buffer = malloc(1);
-	chunk->size = 0;
-	
-	curl_global_init(CURL_GLOBAL_ALL);
-	curl = curl_easy_init();
-	if(!curl)
+	option = argv[*a];
+	if(*a+1 == argc)
 	{
-		fprintf(stderr,"Unable to initialize curl.\n");
+		fprintf(stderr,"Missing value for %s: Use %ld to %ld %s\n",option,min,max,unit);
 		exit(1);
 	}
-
-	/* configure libcurl to read and store the information */
-	curl_easy_setopt(curl, CURLOPT_URL, address);
-	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_mem);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)chunk);
-	curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
-
-	res = curl_easy_perform(curl);
-	if( res != CURLE_OK)
+	(*a)++;
+	errno = 0;
+	value = strtol(argv[*a],&end,10);
+	if(end == argv[*a] || *end != '\0' || errno != 0 || value < min || value > max)
 	{
-		fprintf(stderr,"curl failed: %s\n",curl_easy_strerror(res));
+		fprintf(stderr,"Improper %s value: Use %ld to %ld %s\n",option,min,max,unit);
 		exit(1);
 	}
+	return(value);
+}
 
-	/* clean up */
-	curl_easy_cleanup(curl);
-	
-	return((long)chunk->size);
+/*
+   Set the low speed limit from a BYTES:SECONDS argument
+   Returns 0 on success, -1 if the format is improper.
+*/
+int parse_low_speed(const char *text, struct fetch_config *cfg)
+{
+	const char *seconds;
+	char *end;
+	long bytes,time;
+
+	errno = 0;
+	bytes = strtol(text,&end,10);
+	if(end == text || *end != ':' || errno != 0 || bytes < 0)
+		return(-1);
+	seconds = end+1;
+	time = strtol(seconds,&end,10);
+	if(end == seconds || *end != '\0' || errno != 0 || time < 0 || time > TIMESTAMP_DAY)
+		return(-1);
+	cfg->low_speed_limit = bytes;
+	cfg->low_speed_time = time;
+	return(0);
 }
 
 /*
-   Routine used by libcurl to store web page data into a buffer
-   `ptr` = delivered data
-   `size` = size of chunk
-   `nmemb` = number of chunks
-   `userdata` = storage, set by CALLOPT_WRITEDATA (`chunk` in this code )
+   Prepare the pages of the day starting at `midnight`
 */
-static size_t write_mem(void *ptr, size_t size, size_t nmemb, void *userdata)
+void setup_day(struct run *run, struct day *day, long midnight)
 {
-	size_t realsize;
-	struct web_data *mem;
+	char stamp[TIMESTAMP_SIZE];
+	int st,c;
+	struct page *page;
 
-	realsize = size * nmemb;
-	mem = (struct web_data *)userdata;
-	
-	/* re-size the input buffer to accomodate the information read */
-	mem->buffer = realloc(mem->buffer, mem->size + realsize + 1);
-	if(mem->buffer == NULL)
+	/* web page address format: YYYY_MM_DD */
+	format_timestamp(midnight,stamp);
+	memcpy(day->year,stamp,4);
+	day->year[4] = '\0';
+	memcpy(day->date,stamp,10);
+	day->date[10] = '\0';
+
+	/* the table is kept from one day to the next, see release_day() */
+	if(day->pages == NULL)
+		day->pages = (struct page *)malloc(run->stations*run->channels*sizeof(struct page));
+	if(day->pages == NULL)
 	{
 		fprintf(stderr,"Unable to allocate buffer for web page storage.\n");
 		exit(1);
 	}
+	memset(day->pages,0,run->stations*run->channels*sizeof(struct page));
+	for(st=0;st<run->stations;st++)
+	{
+		for(c=0;c<run->channels;c++)
+		{
+			page = &day->pages[st*run->channels+c];
+			page->station = run->station[st];
+			page->year = day->year;
+			page->date = day->date;
+			page->channel = run->channel[c];
+		}
+	}
+}
 
-	memcpy(&(mem->buffer[mem->size]),ptr,realsize);
-	mem->size += realsize;
-	mem->buffer[mem->size] = 0;
+/*
+   Read the web pages of every station through the same pool, with the
+   calling thread's fetcher. The time taken goes into `days`, which also
+   belongs to the calling thread.
+*/
+void download_day(struct run *run, struct fetcher *f, struct day *day, struct hdr_hist *days)
+{
+	double started,began;
+	int st;
 
-	return(realsize);
+	began = now_ms();
+	started = trace_now();
+	/* find the byte range of the time window in each station's pages */
+	if(run->window_end >= 0)
+		for(st=0;st<run->stations;st++)
+			set_window(f,day->pages+st*run->channels,run->channels,
+					run->window_start,run->window_end,&run->cfg,&run->latencies);
+	fetch_web_pages(f,day->pages,run->stations*run->channels,&run->cfg,&run->latencies);
+	trace_span("fetch","download day",started,day->date);
+	hdr_record(days,(long)((now_ms() - began) * 1000));
 }
 
 /*
-   output a line of text at a given offset, no \n
-   skip over the CR/LF combo at the end of the line
-   return the number of characters written
+   Output the day's data in one column per channel. Each station's
+   --split file, or the memory stream its table is merged from, is
+   opened on the first day and kept for the rest of the run.
+   Returns -1 if a station's data is missing.
 */
-int write_line(char *text,int offset)
+int output_day(struct run *run, struct day *day)
 {
-	char *temp;
-	
-	temp = text;
-	text += offset;
-	while(isprint(*text))
+	struct table_output out;
+	struct page *pages;
+	char *table[MAX_STATIONS];
+	size_t table_size[MAX_STATIONS];
+	char path[FILENAME_MAX];
+	double started,merging;
+	int st,result;
+
+	started = trace_now();
+	out.channels = run->channels;
+	out.start = run->window_start;
+	out.end = run->window_end;
+	out.ring = NULL;
+	if(run->stations == 1 && run->split_dir == NULL)
 	{
-		putchar(*text);
-		text++;
+		if(page_error(day->pages,run->channels))
+		{
+			fprintf(stderr,"Web page error reported for %s.\n",day->date);
+			return(-1);
+		}
+		out.fp = stdout;
+		out.tag = NULL;
+		out.ring = run->ring;
+		write_station(day->pages,&out,&run->ro);
+		trace_span("output","write day",started,day->date);
+		return(0);
 	}
-	text+=2;		/* skip over 0x0d and 0x0a at the end of each line */
-	
-	return(text-temp);
+
+	result = 0;
+	for(st=0;st<run->stations;st++)
+	{
+		table[st] = NULL;
+		table_size[st] = 0;
+		pages = day->pages+st*run->channels;
+		if(page_error(pages,run->channels))
+		{
+			fprintf(stderr,"Web page error reported for station %s on %s.\n",
+					run->station[st],day->date);
+			result = -1;
+			continue;
+		}
+		if(run->table[st] == NULL)
+		{
+			if(run->split_dir)
+			{
+				/* one untagged table per station */
+				snprintf(path,sizeof(path),"%s/%s",run->split_dir,run->station[st]);
+				run->table[st] = fopen(path,"w");
+			}
+			else	/* tagged tables, merged by time below */
+				run->table[st] = open_memstream(&run->table_buffer[st],&run->table_size[st]);
+			if(run->table[st] == NULL)
+			{
+				fprintf(stderr,"Unable to write table for station %s.\n",run->station[st]);
+				exit(1);
+			}
+		}
+		/* the memory stream's text is overwritten day by day */
+		else if(run->split_dir == NULL)
+			rewind(run->table[st]);
+		out.fp = run->table[st];
+		out.tag = run->split_dir ? NULL : run->station[st];
+		merging = trace_now();
+		write_station(pages,&out,&run->ro);
+		fflush(out.fp);
+		if(run->split_dir == NULL)
+		{
+			table[st] = run->table_buffer[st];
+			table_size[st] = run->table_size[st];
+		}
+		trace_span("output","merge channels",merging,run->station[st]);
+	}
+	if(run->split_dir == NULL)
+	{
+		merging = trace_now();
+		merge_tables(table,table_size,run->stations,stdout);
+		trace_span("output","merge stations",merging,NULL);
+	}
+	trace_span("output","write day",started,day->date);
+	return(result);
 }
 
 /*
-   	Output help/about message
+   Return the day's page buffers to the pool. The page table itself is
+   kept for the next day, until free_day().
 */
-void show_help(void)
+void release_day(struct run *run, struct day *day)
 {
-	puts("fetch_data\nWritten by Dan Gookin, 2015\n");
-	puts("Fetches air temperature, barometric pressure, and wind speed data from");
-	puts("http://lpo.dt.navy.mil/, Acoustic Research Dept. Lake Pend Oreille, ID\n");
-	puts("No options: Fetch current day's data (results may be incomplete)");
-	puts("YYYYMMDD    Fetch data for given date");
-	puts("--help      Show this message\n");
-	puts("Output is in the format: Date Time Air_temp Bar_press Wind_speed");
+	int p;
+
+	for(p=0;p<run->stations*run->channels;p++)
+		if(day->pages[p].data.buffer)
+			pool_put(&run->pool,&day->pages[p].data);
+}
+
+void free_day(struct day *day)
+{
+	free(day->pages);
+	day->pages = NULL;
+}
+
+/*
+   Close the stations' --split files and memory streams at the end of
+   the run
+*/
+void close_tables(struct run *run)
+{
+	int st;
+
+	for(st=0;st<run->stations;st++)
+	{
+		if(run->table[st])
+			fclose(run->table[st]);
+		free(run->table_buffer[st]);
+		run->table[st] = NULL;
+		run->table_buffer[st] = NULL;
+	}
+}
+
+/*
+   Restrict a station's pages to the time of day window [start,end)
+
+   The first probe reads the start of the first page, which gives the
+   line size and the typical sampling interval. The byte offsets of the
+   window's ends are then found by locate_time() and requested as a Range
+   of every page, since the channels of a station share one layout.
+   When anything doesn't add up the pages are fetched whole; the rows
+   outside the window are dropped either way.
+   Returns 0 if a range was set.
+*/
+int set_window(struct fetcher *f, struct page *pages, int channels, long start, long end,
+		struct fetch_config *cfg, struct latency_log *log)
+{
+	double started;
+	int result;
+
+	started = trace_now();
+	result = locate_window(f,pages,channels,start,end,cfg,log);
+	trace_span("fetch","locate window",started,pages[0].station);
+	return(result);
+}
+
+/*
+	The work of set_window()
+*/
+static int locate_window(struct fetcher *f, struct page *pages, int channels, long start, long end,
+		struct fetch_config *cfg, struct latency_log *log)
+{
+	struct page probe;
+	char *crlf;
+	long first,last,line_size,lines,start_line,end_line;
+	double interval;
+	int c;
+
+	if(probe_page(f,pages,0,&probe,cfg,log) != 0)
+		return(-1);
+	crlf = strstr(probe.data.buffer,"\r\n");
+	if(crlf == NULL || probe.data.size > PROBE_SIZE)
+	{
+		/* no complete line, or the server ignored the Range */
+		pool_put(cfg->pool,&probe.data);
+		return(-1);
+	}
+	line_size = crlf - probe.data.buffer + 2;
+	lines = (long)probe.data.size / line_size;
+	first = parse_time_of_day(probe.data.buffer+11);
+	last = parse_time_of_day(probe.data.buffer+(lines-1)*line_size+11);
+	pool_put(cfg->pool,&probe.data);
+	if(lines < 2 || first < 0 || last <= first)
+		return(-1);
+	interval = (double)(last - first) / (lines - 1);
+
+	start_line = locate_time(f,pages,start,line_size,interval,cfg,log);
+	end_line = locate_time(f,pages,end-1,line_size,interval,cfg,log);
+	if(start_line < 0 || end_line < -1)
+		return(-1);
+	start_line = start_line > PROBE_MARGIN ? start_line - PROBE_MARGIN : 0;
+
+	for(c=0;c<channels;c++)
+	{
+		if(end_line < 0)	/* the window runs past the last line */
+			snprintf(pages[c].range,sizeof(pages[c].range),"%ld-",start_line*line_size);
+		else
+			snprintf(pages[c].range,sizeof(pages[c].range),"%ld-%ld",
+					start_line*line_size,(end_line+PROBE_MARGIN+1)*line_size-1);
+	}
+	return(0);
 }
 
+/*
+   Find the last line of `model`'s page timed at or before `target`
+   (seconds into the day). The line is first estimated from the
+   sampling interval, then probed and corrected until the probe's lines
+   straddle the target.
+   Returns the line number, -1 if the target lies beyond the last line,
+   or -2 if it couldn't be found.
+*/
+static long locate_time(struct fetcher *f, struct page *model, long target, long line_size,
+		double interval, struct fetch_config *cfg, struct latency_log *log)
+{
+	struct page probe;
+	long line,lines,first,last,t,x;
+	int tries;
+
+	line = (long)(target / interval);		/* first guess: no gaps since midnight */
+	for(tries=0;tries<MAX_PROBES;tries++)
+	{
+		if(line < 0)
+			line = 0;
+		if(probe_page(f,model,line*line_size,&probe,cfg,log) != 0)
+		{
+			/* past the end of the page, probably */
+			if(line == 0)
+				return(-2);
+			line /= 2;
+			continue;
+		}
+		lines = (long)probe.data.size / line_size;
+		first = lines ? parse_time_of_day(probe.data.buffer+11) : -1;
+		last = lines ? parse_time_of_day(probe.data.buffer+(lines-1)*line_size+11) : -1;
+		if(first < 0 || last < 0)
+		{
+			pool_put(cfg->pool,&probe.data);
+			return(-2);
+		}
+		if(target < first)
+		{
+			if(line == 0)
+			{
+				pool_put(cfg->pool,&probe.data);
+				return(0);
+			}
+			line -= (long)((first - target) / interval) + 1;
+		}
+		else if(target > last && probe.data.size == PROBE_SIZE)
+			line += lines - 1 + (long)((target - last) / interval);
+		else
+		{
+			/* the target is within this probe, or after the last line */
+			if(target > last)
+			{
+				pool_put(cfg->pool,&probe.data);
+				return(-1);
+			}
+			for(x=1;x<lines;x++)
+			{
+				t = parse_time_of_day(probe.data.buffer+x*line_size+11);
+				if(t < 0 || t > target)
+					break;
+			}
+			pool_put(cfg->pool,&probe.data);
+			return(line + x - 1);
+		}
+		pool_put(cfg->pool,&probe.data);
+	}
+	return(-2);
+}
 
+/*
+   Read PROBE_SIZE bytes of `model`'s page from `offset`
+   Returns 0 on success, with the text in `probe->data`
+*/
+static int probe_page(struct fetcher *f, struct page *model, long offset, struct page *probe,
+		struct fetch_config *cfg, struct latency_log *log)
+{
+	memset(probe,0,sizeof(*probe));
+	probe->station = model->station;
+	probe->year = model->year;
+	probe->date = model->date;
+	probe->channel = model->channel;
+	probe->quiet = 1;
+	snprintf(probe->range,sizeof(probe->range),"%ld-%ld",offset,offset+PROBE_SIZE-1);
+	fetch_web_pages(f,probe,1,cfg,log);
+	if(probe->failed || probe->data.size == 0)
+	{
+		pool_put(cfg->pool,&probe->data);
+		return(-1);
+	}
+	return(0);
+}
+
+/*
+   Convert `HH:MM` or `HH:MM:SS` to seconds into the day, -1 if malformed
+*/
+long parse_time_of_day(const char *text)
+{
+	int h,m,sec;
+
+	if(!isdigit(text[0]) || !isdigit(text[1]) || text[2] != ':' ||
+			!isdigit(text[3]) || !isdigit(text[4]))
+		return(-1);
+	h = (text[0]-'0')*10 + text[1]-'0';
+	m = (text[3]-'0')*10 + text[4]-'0';
+	sec = 0;
+	if(text[5] == ':' && isdigit(text[6]) && isdigit(text[7]))
+		sec = (text[6]-'0')*10 + text[7]-'0';
+	if(h > 24 || m > 59 || sec > 59 || (h == 24 && (m || sec)))
+		return(-1);
+	return(h*3600L + m*60L + sec);
+}
+
+/*
+   Build a web page address from `template`, replacing the fields
+   {base}, {station}, {year}, {date} (YYYY_MM_DD) and {channel}
+   Returns 0, or -1 if the address doesn't fit or a field is unknown
+*/
+int build_address(char *address, size_t size, const char *template, const char *base,
+		const char *station, const char *year, const char *date, const char *channel)
+{
+	const char *field,*close;
+	size_t used,len;
+
+	used = 0;
+	while(*template)
+	{
+		if(*template == '{' && (close = strchr(template,'}')) != NULL)
+		{
+			len = close - template - 1;
+			if(len == 4 && strncmp(template+1,"base",4) == 0)
+				field = base;
+			else if(len == 7 && strncmp(template+1,"station",7) == 0)
+				field = station;
+			else if(len == 4 && strncmp(template+1,"year",4) == 0)
+				field = year;
+			else if(len == 4 && strncmp(template+1,"date",4) == 0)
+				field = date;
+			else if(len == 7 && strncmp(template+1,"channel",7) == 0)
+				field = channel;
+			else
+				return(-1);
+			len = strlen(field);
+			if(used + len >= size)
+				return(-1);
+			memcpy(address+used,field,len);
+			used += len;
+			template = close+1;
+		}
+		else
+		{
+			if(used + 1 >= size)
+				return(-1);
+			address[used++] = *template++;
+		}
+	}
+	address[used] = '\0';
+	return(0);
+}
+
+/*
+   Split a comma-separated list in place
+   Returns the number of items, or 0 if there are more than `max`
+   or any of them is empty
+*/
+int split_list(char *list, char **item, int max)
+{
+	int count;
+
+	count = 0;
+	while(1)
+	{
+		if(count == max || *list == '\0' || *list == ',')
+			return(0);
+		item[count++] = list;
+		list = strchr(list,',');
+		if(list == NULL)
+			break;
+		*list++ = '\0';
+	}
+	return(count);
+}
+
+/*
+	Set up a thread's fetcher: its multi handle, and no transfers yet
+*/
+void fetcher_init(struct fetcher *f)
+{
+	memset(f,0,sizeof(*f));
+	f->multi = curl_multi_init();
+	if(!f->multi)
+	{
+		fprintf(stderr,"Unable to initialize curl.\n");
+		exit(1);
+	}
+}
+
+/*
+	Release a fetcher and its transfers, none of which may be running
+*/
+void fetcher_free(struct fetcher *f)
+{
+	struct transfer *x;
+
+	while( (x = f->idle) != NULL)
+	{
+		f->idle = x->next;
+		if(x->curl)
+			curl_easy_cleanup(x->curl);
+		if(x->raw_kept)
+		{
+			if(x->raw_kept->deflating)
+				deflateEnd(&x->raw_kept->z);
+			free(x->raw_kept->buffer);
+			free(x->raw_kept);
+		}
+		free(x->headers.buffer);
+		free(x->chunk);
+		free(x);
+	}
+	curl_multi_cleanup(f->multi);
+	f->multi = NULL;
+}
+
+/*
+	Fill the web data buffers with text read from the web pages
+
+	All pages are transferred through the fetcher's multi handle, at most
+	`max_transfers` of them at a time. Each page
+	starts on the first mirror. When a transfer fails the next mirror is
+	tried, and only when every mirror has failed is the page given up on.
+	When a transfer runs longer than the hedge delay a duplicate goes to
+	the next mirror; the first copy to arrive wins and the other is
+	abandoned.
+ */
+void fetch_web_pages(struct fetcher *f, struct page *pages, int n, struct fetch_config *cfg,
+		struct latency_log *log)
+{
+	CURLMsg *msg;
+	struct transfer *x;
+	struct page *page;
+	int p,running,queued,remaining,active,waiting;
+	long wait;
+	double delay;
+
+	remaining = n;
+	active = 0;
+	waiting = 0;		/* pages[waiting..n) haven't been started */
+	while(remaining > 0)
+	{
+		while(waiting < n && active < cfg->max_transfers)
+		{
+			start_transfer(f,&pages[waiting++],cfg);
+			active++;
+		}
+		curl_multi_perform(f->multi,&running);
+
+		/* collect finished transfers */
+		while( (msg = curl_multi_info_read(f->multi,&queued)) != NULL)
+		{
+			if(msg->msg != CURLMSG_DONE)
+				continue;
+			curl_easy_getinfo(msg->easy_handle,CURLINFO_PRIVATE,(char **)&x);
+			remaining -= end_transfer(f,x,msg->data.result,cfg,log,&active);
+		}
+		wait = POLL_MS;
+		if(cfg->replay)
+			remaining -= replay_transfers(f,pages,waiting,cfg,log,&active,&wait);
+
+		/* hedge transfers that are running long */
+		delay = hedge_delay(log,cfg);
+		for(p=0;p<waiting && delay > 0 && active < cfg->max_transfers;p++)
+		{
+			page = &pages[p];
+			if(page->done || page->hedged || page->xfer[0] == NULL)
+				continue;
+			if(now_ms() - page->xfer[0]->started > delay)
+			{
+				page->hedged = 1;
+				start_transfer(f,page,cfg);
+				active++;
+			}
+		}
+
+		if(remaining > 0)
+			curl_multi_poll(f->multi,NULL,0,(int)wait,NULL);
+	}
+}
+
+/*
+	Deal with a transfer that ended with `result`: deliver its page, or
+	try the next mirror, or give the page up. Returns 1 if the page is
+	settled either way.
+*/
+static int end_transfer(struct fetcher *f, struct transfer *x, int result, struct fetch_config *cfg,
+		struct latency_log *log, int *active)
+{
+	struct page *page;
+
+	page = x->page;
+	if(x->record)
+		record_transfer(x,result);
+	if(result == CURLE_OK)
+	{
+		x->outcome = "delivered";
+		/* a probe's few bytes would pull the hedge delay down */
+		if(!page->quiet)
+			record_latency(log,now_ms() - x->started);
+		page->data = x->data;
+		x->data.buffer = NULL;
+		if(x->raw)
+		{
+			raw_close(x->raw,1);
+			x->raw = NULL;
+		}
+		page->done = 1;
+		/* abandon the other copy, if any */
+		if(page->xfer[0]) { finish_transfer(f,page->xfer[0]); (*active)--; }
+		if(page->xfer[1]) { finish_transfer(f,page->xfer[1]); (*active)--; }
+		return(1);
+	}
+
+	if(!page->quiet)
+	{
+		if(x->replaying && x->replay == NULL)
+			fprintf(stderr,"%s: Not in the recording\n",x->url);
+		else
+			fprintf(stderr,"%s: %s\n",x->url,curl_easy_strerror(result));
+	}
+	page->failures++;
+	x->outcome = "failed";
+	finish_transfer(f,x);
+	(*active)--;
+	if(page->xfer[0] != NULL || page->xfer[1] != NULL)
+		return(0);
+	if(page->failures < cfg->mirrors)
+	{
+		start_transfer(f,page,cfg);
+		(*active)++;
+		return(0);
+	}
+	/* give up on the page, the caller decides what that means */
+	if(!page->quiet)
+		fprintf(stderr,"curl failed: no mirror could deliver %s %s for %s\n",
+				page->station,page->channel,page->date);
+	pool_get(cfg->pool,&page->data);
+	page->done = 1;
+	page->failed = 1;
+	return(1);
+}
+
+/*
+	Hand the replayed transfers of pages[0..n) the body they have coming
+	through write_mem(), all at once or, with --replay-timed, as much as
+	had arrived by now when it was recorded. A transfer ends as it did
+	then. `wait` is cut to the milliseconds until the next piece is due,
+	or to 0 when not keeping time, as nothing else is waited for.
+	Returns the number of pages settled.
+*/
+static int replay_transfers(struct fetcher *f, struct page *pages, int n, struct fetch_config *cfg,
+		struct latency_log *log, int *active, long *wait)
+{
+	struct transfer *x;
+	struct fixture_response *r;
+	double elapsed,due;
+	int p,slot,settled;
+
+	settled = 0;
+	if(!cfg->replay_timed)
+		*wait = 0;
+	for(p=0;p<n;p++)
+	{
+		for(slot=0;slot<2;slot++)
+		{
+			x = pages[p].xfer[slot];
+			if(x == NULL || !x->replaying)
+				continue;
+			r = x->replay;
+			if(r == NULL)
+			{
+				settled += end_transfer(f,x,CURLE_REMOTE_FILE_NOT_FOUND,cfg,log,active);
+				continue;
+			}
+			elapsed = now_ms() - x->started;
+			while(x->replay_next < r->chunks &&
+					(!cfg->replay_timed || r->chunk[x->replay_next].ms <= elapsed))
+			{
+				write_mem(r->body + x->replay_offset,1,r->chunk[x->replay_next].size,x);
+				x->replay_offset += r->chunk[x->replay_next].size;
+				x->replay_next++;
+			}
+			due = x->replay_next < r->chunks ? r->chunk[x->replay_next].ms : r->total_ms;
+			if(cfg->replay_timed && due > elapsed)
+			{
+				if(due - elapsed < *wait)
+					*wait = (long)(due - elapsed) + 1;
+				continue;
+			}
+			settled += end_transfer(f,x,r->result,cfg,log,active);
+		}
+	}
+	return(settled);
+}
+
+/*
+	Add a finished transfer to the --record file
+*/
+static void record_transfer(struct transfer *x, int result)
+{
+	struct fixture_response r;
+
+	memset(&r,0,sizeof(r));
+	r.url = x->url;
+	r.range = x->page->range;
+	r.result = result;
+	r.headers = x->headers.buffer;
+	r.header_size = x->headers.size;
+	r.chunk = x->chunk;
+	r.chunks = x->chunks;
+	r.body = x->data.buffer;
+	r.body_size = x->data.size;
+	r.total_ms = now_ms() - x->started;
+	fixture_write(x->record,&r);
+}
+
+/*
+	Start a request for `page` on the next mirror in line, with an idle
+	transfer when the fetcher has one
+*/
+static void start_transfer(struct fetcher *f, struct page *page, struct fetch_config *cfg)
+{
+	struct transfer *x;
+	int slot;
+
+	slot = page->xfer[0] == NULL ? 0 : 1;
+	if(f->idle)
+	{
+		x = f->idle;
+		f->idle = x->next;
+		f->reused++;
+	}
+	else
+	{
+		x = (struct transfer *)calloc(1,sizeof(struct transfer));
+		if(x == NULL)
+		{
+			fprintf(stderr,"Unable to allocate buffer for web page storage.\n");
+			exit(1);
+		}
+		f->created++;
+	}
+	/* what the last request left behind, the handle and buffers aside */
+	x->headers.size = 0;
+	x->chunks = 0;
+	x->replay_next = 0;
+	x->replay_offset = 0;
+	x->next = NULL;
+	x->page = page;
+	x->pool = cfg->pool;
+	x->outcome = "abandoned";
+	pool_get(cfg->pool,&x->data);
+	if(build_address(x->url,URL_SIZE,cfg->template,cfg->mirror[page->attempts % cfg->mirrors],
+			page->station,page->year,page->date,page->channel) != 0)
+	{
+		fprintf(stderr,"Improper address template: %s\n",cfg->template);
+		exit(1);
+	}
+	page->attempts++;
+	x->record = cfg->record;
+
+	x->replaying = cfg->replay != NULL;
+	x->replay = NULL;
+	if(x->replaying)	/* no request, see replay_transfers() */
+		x->replay = fixture_find(cfg->replay,x->url,page->range);
+	else if(x->curl)
+		curl_easy_reset(x->curl);
+	else
+		x->curl = curl_easy_init();
+	if((!x->replaying && !x->curl) || x->data.buffer == NULL)
+	{
+		fprintf(stderr,"Unable to initialize curl.\n");
+		exit(1);
+	}
+	if(cfg->raw_dir && !page->quiet)
+		x->raw = x->raw_kept = raw_open(cfg,page,x->raw_kept);
+	x->started = now_ms();
+	page->xfer[slot] = x;
+	if(x->replaying)
+		return;
+
+	/* configure libcurl to read and store the information */
+	curl_easy_setopt(x->curl, CURLOPT_URL, x->url);
+	curl_easy_setopt(x->curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(x->curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(x->curl, CURLOPT_WRITEFUNCTION, write_mem);
+	curl_easy_setopt(x->curl, CURLOPT_WRITEDATA, (void *)x);
+	curl_easy_setopt(x->curl, CURLOPT_PRIVATE, (char *)x);
+	curl_easy_setopt(x->curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+	curl_easy_setopt(x->curl, CURLOPT_TIMEOUT, cfg->timeout);
+	curl_easy_setopt(x->curl, CURLOPT_CONNECTTIMEOUT, cfg->connect_timeout);
+	curl_easy_setopt(x->curl, CURLOPT_LOW_SPEED_LIMIT, cfg->low_speed_limit);
+	curl_easy_setopt(x->curl, CURLOPT_LOW_SPEED_TIME, cfg->low_speed_time);
+	if(page->range[0])
+		curl_easy_setopt(x->curl, CURLOPT_RANGE, page->range);
+	if(x->record)
+	{
+		curl_easy_setopt(x->curl, CURLOPT_HEADERFUNCTION, header_mem);
+		curl_easy_setopt(x->curl, CURLOPT_HEADERDATA, (void *)x);
+	}
+	curl_multi_add_handle(f->multi,x->curl);
+}
+
+/*
+	Remove a transfer from the multi handle and put it back on the
+	fetcher's idle list
+*/
+static void finish_transfer(struct fetcher *f, struct transfer *x)
+{
+	struct page *page;
+	char detail[URL_SIZE+16];
+
+	page = x->page;
+	if(trace_enabled)
+	{
+		snprintf(detail,sizeof(detail),"%s %s",x->outcome,x->url);
+		trace_async("fetch","transfer",(unsigned long)x,x->started*1000,detail);
+	}
+	if(page->xfer[0] == x) page->xfer[0] = NULL;
+	if(page->xfer[1] == x) page->xfer[1] = NULL;
+	if(!x->replaying)
+		curl_multi_remove_handle(f->multi,x->curl);
+	if(x->raw)
+	{
+		raw_close(x->raw,0);
+		x->raw = NULL;
+	}
+	if(x->data.buffer) pool_put(x->pool,&x->data);
+	x->next = f->idle;
+	f->idle = x;
+}
+
+/*
+	Keep the time taken by a successful transfer, for --latency-stats
+	and in the hedging window. The window is two halves of HEDGE_WINDOW
+	transfers; when the newer one is full the older is emptied and
+	takes over, so a slow start is forgotten after a few hundred
+	transfers instead of setting the hedge delay for the whole run.
+*/
+static void record_latency(struct latency_log *log, double ms)
+{
+	struct hdr_hist *h;
+	long us;
+
+	us = (long)(ms * 1000);
+	pthread_mutex_lock(&log->lock);
+	hdr_record(&log->transfers,us);
+	h = &log->recent[log->filling];
+	if(h->total == HEDGE_WINDOW)
+	{
+		log->filling = !log->filling;
+		h = &log->recent[log->filling];
+		hdr_init(h);
+	}
+	hdr_record(h,us);
+	hdr_init(&log->window);
+	hdr_merge(&log->window,&log->recent[0]);
+	hdr_merge(&log->window,&log->recent[1]);
+	log->hedge_us = log->window.total < HEDGE_MIN_SAMPLES ? 0 : hdr_percentile(&log->window,95);
+	pthread_mutex_unlock(&log->lock);
+}
+
+/*
+	How long a transfer may run before it is hedged: the 95th percentile
+	of the recent transfers once there are enough of them, the configured
+	delay until then. Returns 0 when hedging is off.
+*/
+static double hedge_delay(struct latency_log *log, struct fetch_config *cfg)
+{
+	long p95;
+
+	if(cfg->hedge_ms <= 0)
+		return(0);
+	pthread_mutex_lock(&log->lock);
+	p95 = log->hedge_us;
+	pthread_mutex_unlock(&log->lock);
+	if(p95 == 0)
+		return((double)cfg->hedge_ms);
+	return(p95 / 1000.0);
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return(ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6);
+}
+
+/*
+   Routine used by libcurl to store web page data into a buffer
+   `ptr` = delivered data
+   `size` = size of chunk
+   `nmemb` = number of chunks
+   `userdata` = storage, set by CALLOPT_WRITEDATA (the transfer in this code)
+   With --save-raw the data is also passed on to disk as it arrives
+*/
+static size_t write_mem(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	size_t realsize;
+	struct transfer *x;
+	struct web_data *mem;
+
+	realsize = size * nmemb;
+	x = (struct transfer *)userdata;
+	mem = &x->data;
+	if(x->raw)
+		raw_write(x->raw,ptr,realsize);
+	if(x->record)
+	{
+		if(x->chunks == x->chunk_capacity)
+		{
+			x->chunk_capacity = x->chunk_capacity ? x->chunk_capacity*2 : 64;
+			x->chunk = (struct fixture_chunk *)realloc(x->chunk,
+					x->chunk_capacity*sizeof(struct fixture_chunk));
+			if(x->chunk == NULL)
+			{
+				fprintf(stderr,"Unable to allocate memory for the recording.\n");
+				exit(1);
+			}
+		}
+		x->chunk[x->chunks].ms = now_ms() - x->started;
+		x->chunk[x->chunks].size = realsize;
+		x->chunks++;
+	}
+	
+	/* re-size the input buffer to accomodate the information read */
+	if(mem->size + realsize + 1 > mem->capacity)
+		pool_grow(x->pool,mem,mem->size + realsize + 1);
+
+	memcpy(&(mem->buffer[mem->size]),ptr,realsize);
+	mem->size += realsize;
+	mem->buffer[mem->size] = 0;
+
+	return(realsize);
+}
+
+/*
+   Routine used by libcurl to pass on the response headers, kept with
+   --record
+*/
+static size_t header_mem(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	size_t realsize;
+	struct web_data *mem;
+	char *grown;
+
+	realsize = size * nmemb;
+	mem = &((struct transfer *)userdata)->headers;
+	if(mem->size + realsize > mem->capacity)
+	{
+		grown = (char *)realloc(mem->buffer,mem->size + realsize + 256);
+		if(grown == NULL)
+			return(0);
+		mem->buffer = grown;
+		mem->capacity = mem->size + realsize + 256;
+	}
+	memcpy(mem->buffer + mem->size,ptr,realsize);
+	mem->size += realsize;
+	return(realsize);
+}
+
+/*
+   Write `days` days starting at `first` while the following ones
+   download. One thread per day of lookahead claims the next day not yet
+   started, but never runs more than run->lookahead days ahead of the
+   day being written. Returns the number of days that failed.
+*/
+int run_lookahead(struct run *run, long first, int days)
+{
+	struct reorder ro;
+	pthread_t thread[MAX_LOOKAHEAD];
+	int threads,t,d,s,failed;
+
+	memset(&ro,0,sizeof(ro));
+	pthread_mutex_init(&ro.lock,NULL);
+	pthread_cond_init(&ro.ready,NULL);
+	pthread_cond_init(&ro.space,NULL);
+	ro.run = run;
+	ro.slots = run->lookahead+1;
+	ro.first = first;
+	ro.days = days;
+
+	threads = run->lookahead < days ? run->lookahead : days;
+	for(t=0;t<threads;t++)
+	{
+		if(pthread_create(&thread[t],NULL,lookahead_thread,&ro) != 0)
+		{
+			fprintf(stderr,"Unable to start download thread.\n");
+			exit(1);
+		}
+	}
+
+	failed = 0;
+	for(d=0;d<days;d++)
+	{
+		s = d % ro.slots;
+		pthread_mutex_lock(&ro.lock);
+		while(!ro.done[s])
+			pthread_cond_wait(&ro.ready,&ro.lock);
+		pthread_mutex_unlock(&ro.lock);
+
+		if(output_day(run,&ro.slot[s]) != 0)
+			failed++;
+		release_day(run,&ro.slot[s]);
+
+		pthread_mutex_lock(&ro.lock);
+		ro.done[s] = 0;
+		ro.next_output++;
+		pthread_cond_broadcast(&ro.space);
+		pthread_mutex_unlock(&ro.lock);
+	}
+
+	for(t=0;t<threads;t++)
+		pthread_join(thread[t],NULL);
+	for(s=0;s<ro.slots;s++)
+		free_day(&ro.slot[s]);
+	pthread_cond_destroy(&ro.space);
+	pthread_cond_destroy(&ro.ready);
+	pthread_mutex_destroy(&ro.lock);
+	return(failed);
+}
+
+/*
+   Download days for run_lookahead() until there are none left, with a
+   fetcher of the thread's own
+*/
+static void *lookahead_thread(void *arg)
+{
+	struct reorder *ro;
+	struct hdr_hist *days;
+	struct fetcher f;
+	int d,s;
+
+	ro = (struct reorder *)arg;
+	trace_thread_name("lookahead");
+	fetcher_init(&f);
+	days = (struct hdr_hist *)malloc(sizeof(struct hdr_hist));
+	if(days == NULL)
+	{
+		fprintf(stderr,"Unable to allocate memory for download thread.\n");
+		exit(1);
+	}
+	hdr_init(days);
+	pthread_mutex_lock(&ro->lock);
+	for(;;)
+	{
+		/* the slot of day d is free once day d-slots is written */
+		while(ro->next_fetch < ro->days && ro->next_fetch >= ro->next_output + ro->slots)
+			pthread_cond_wait(&ro->space,&ro->lock);
+		if(ro->next_fetch >= ro->days)
+			break;
+		d = ro->next_fetch++;
+		s = d % ro->slots;
+		pthread_mutex_unlock(&ro->lock);
+
+		setup_day(ro->run,&ro->slot[s],ro->first + d*TIMESTAMP_DAY);
+		download_day(ro->run,&f,&ro->slot[s],days);
+
+		pthread_mutex_lock(&ro->lock);
+		ro->done[s] = 1;
+		pthread_cond_broadcast(&ro->ready);
+	}
+	pthread_mutex_unlock(&ro->lock);
+
+	pthread_mutex_lock(&ro->run->latencies.lock);
+	hdr_merge(&ro->run->latencies.days,days);
+	ro->run->fetcher.reused += f.reused;
+	ro->run->fetcher.created += f.created;
+	pthread_mutex_unlock(&ro->run->latencies.lock);
+	fetcher_free(&f);
+	free(days);
+	return(NULL);
+}
+
+/*
+   Hand out an empty page buffer. An idle buffer is reused when there
+   is one, the largest first; otherwise a new one is allocated at the
+   size of the recent pages, so it rarely needs to grow.
+*/
+void pool_get(struct buffer_pool *pool, struct web_data *data)
+{
+	int x,best;
+
+	pthread_mutex_lock(&pool->lock);
+	if(pool->hint == 0)
+		pool->hint = 64*1024;
+	if(pool->idle_count > 0)
+	{
+		best = 0;
+		for(x=1;x<pool->idle_count;x++)
+			if(pool->idle_capacity[x] > pool->idle_capacity[best])
+				best = x;
+		data->buffer = pool->idle[best];
+		data->capacity = pool->idle_capacity[best];
+		pool->idle_count--;
+		pool->idle[best] = pool->idle[pool->idle_count];
+		pool->idle_capacity[best] = pool->idle_capacity[pool->idle_count];
+		pool->hits++;
+	}
+	else
+	{
+		data->buffer = malloc(pool->hint);
+		data->capacity = pool->hint;
+		if(data->buffer == NULL)
+		{
+			fprintf(stderr,"Unable to allocate buffer for web page storage.\n");
+			exit(1);
+		}
+		pool->misses++;
+		pool->bytes += pool->hint;
+		if(pool->bytes > pool->peak)
+			pool->peak = pool->bytes;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	data->size = 0;
+	data->buffer[0] = '\0';
+}
+
+/*
+   Enlarge a buffer to hold at least `needed` bytes, by doubling
+*/
+void pool_grow(struct buffer_pool *pool, struct web_data *data, size_t needed)
+{
+	size_t capacity;
+
+	capacity = data->capacity ? data->capacity : 1;
+	while(capacity < needed)
+		capacity *= 2;
+	data->buffer = realloc(data->buffer,capacity);
+	if(data->buffer == NULL)
+	{
+		fprintf(stderr,"Unable to allocate buffer for web page storage.\n");
+		exit(1);
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->grows++;
+	pool->bytes += capacity - data->capacity;
+	if(pool->bytes > pool->peak)
+		pool->peak = pool->bytes;
+	pthread_mutex_unlock(&pool->lock);
+	data->capacity = capacity;
+}
+
+/*
+   Take back a buffer. Its page size feeds the size of new buffers,
+   decaying slowly so one huge page doesn't set it for good.
+*/
+void pool_put(struct buffer_pool *pool, struct web_data *data)
+{
+	pthread_mutex_lock(&pool->lock);
+	if(data->size + 1 > pool->hint - pool->hint/16)
+		pool->hint = data->size + 1;
+	else
+		pool->hint -= pool->hint/16;
+
+	if(pool->idle_count < POOL_SLOTS)
+	{
+		pool->idle[pool->idle_count] = data->buffer;
+		pool->idle_capacity[pool->idle_count] = data->capacity;
+		pool->idle_count++;
+	}
+	else
+	{
+		free(data->buffer);
+		pool->bytes -= data->capacity;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	data->buffer = NULL;
+	data->size = 0;
+	data->capacity = 0;
+}
+
+/*
+   Release the idle buffers
+*/
+void pool_drain(struct buffer_pool *pool)
+{
+	while(pool->idle_count > 0)
+	{
+		pool->idle_count--;
+		free(pool->idle[pool->idle_count]);
+		pool->bytes -= pool->idle_capacity[pool->idle_count];
+	}
+}
+
+/*
+   Open the file that saves `page` as it is served. It is written
+   under a temporary name, which raw_close() renames once the transfer
+   has won, since a hedged page is downloaded twice. `raw` is the one
+   the transfer used for its last page, to be used again, or NULL.
+*/
+static struct raw_file *raw_open(struct fetch_config *cfg, struct page *page, struct raw_file *raw)
+{
+	static int serial = 0;
+	void *buffer;
+	size_t len;
+
+	if(raw == NULL)
+	{
+		raw = (struct raw_file *)calloc(1,sizeof(struct raw_file));
+		if(raw == NULL || posix_memalign(&buffer,RAW_ALIGN,RAW_BUFFER_SIZE) != 0)
+		{
+			fprintf(stderr,"Unable to allocate buffer for web page storage.\n");
+			exit(1);
+		}
+		raw->buffer = (char *)buffer;
+	}
+	raw->used = 0;
+	raw->compress = cfg->raw_compress;
+	/* room for the range and ".gz" */
+	if(build_address(raw->path,sizeof(raw->path)-sizeof(page->range)-16,RAW_TEMPLATE,cfg->raw_dir,
+			page->station,page->year,page->date,page->channel) != 0)
+	{
+		fprintf(stderr,"Raw page path is too long: %s\n",cfg->raw_dir);
+		exit(1);
+	}
+	/* part of a page is never saved under the whole page's name */
+	if(page->range[0])
+	{
+		len = strlen(raw->path);
+		snprintf(raw->path+len,sizeof(raw->path)-len,".range-%s",page->range);
+	}
+	if(raw->compress)
+	{
+		len = strlen(raw->path);
+		strcpy(raw->path+len,".gz");
+		/* windowBits 15+16 writes a gzip header and trailer */
+		if(raw->deflating)
+			deflateReset(&raw->z);
+		else if(deflateInit2(&raw->z,Z_DEFAULT_COMPRESSION,Z_DEFLATED,15+16,8,Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			fprintf(stderr,"Unable to initialize compression.\n");
+			exit(1);
+		}
+		raw->deflating = 1;
+	}
+	/* lookahead threads open pages too, so the count is taken atomically */
+	snprintf(raw->temp,sizeof(raw->temp),"%s.part%ld.%d",raw->path,(long)getpid(),
+			__atomic_fetch_add(&serial,1,__ATOMIC_RELAXED));
+	make_parent_dirs(raw->temp);
+	raw->fd = open(raw->temp,O_WRONLY|O_CREAT|O_TRUNC,0644);
+	if(raw->fd < 0)
+	{
+		fprintf(stderr,"Unable to save raw page %s: %s\n",raw->temp,strerror(errno));
+		exit(1);
+	}
+	return(raw);
+}
+
+/*
+   Add `size` bytes to a saved page. The data is gathered (compressed,
+   if asked) into the aligned buffer and written a full buffer at a time.
+*/
+static void raw_write(struct raw_file *raw, const char *data, size_t size)
+{
+	size_t room;
+
+	if(!raw->compress)
+	{
+		while(size > 0)
+		{
+			room = RAW_BUFFER_SIZE - raw->used;
+			if(room > size)
+				room = size;
+			memcpy(raw->buffer+raw->used,data,room);
+			raw->used += room;
+			data += room;
+			size -= room;
+			if(raw->used == RAW_BUFFER_SIZE)
+				raw_flush(raw);
+		}
+		return;
+	}
+
+	raw->z.next_in = (Bytef *)data;
+	raw->z.avail_in = (uInt)size;
+	while(raw->z.avail_in > 0)
+	{
+		raw->z.next_out = (Bytef *)raw->buffer+raw->used;
+		raw->z.avail_out = (uInt)(RAW_BUFFER_SIZE - raw->used);
+		deflate(&raw->z,Z_NO_FLUSH);
+		raw->used = RAW_BUFFER_SIZE - raw->z.avail_out;
+		if(raw->used == RAW_BUFFER_SIZE)
+			raw_flush(raw);
+	}
+}
+
+/*
+   Write out the buffer
+*/
+static void raw_flush(struct raw_file *raw)
+{
+	ssize_t done;
+	size_t at;
+
+	at = 0;
+	while(at < raw->used)
+	{
+		done = write(raw->fd,raw->buffer+at,raw->used-at);
+		if(done < 0 && errno == EINTR)
+			continue;
+		if(done <= 0)
+		{
+			fprintf(stderr,"Unable to save raw page %s: %s\n",raw->temp,strerror(errno));
+			exit(1);
+		}
+		at += done;
+	}
+	raw->used = 0;
+}
+
+/*
+   Finish a saved page. `keep` is set when its transfer delivered the
+   page; otherwise the partial file is removed. The buffer and the
+   compressor are kept for the transfer's next page.
+*/
+static void raw_close(struct raw_file *raw, int keep)
+{
+	int status;
+
+	if(raw->compress)
+	{
+		if(keep)
+		{
+			do {
+				raw->z.next_out = (Bytef *)raw->buffer+raw->used;
+				raw->z.avail_out = (uInt)(RAW_BUFFER_SIZE - raw->used);
+				status = deflate(&raw->z,Z_FINISH);
+				raw->used = RAW_BUFFER_SIZE - raw->z.avail_out;
+				if(raw->used == RAW_BUFFER_SIZE || status == Z_STREAM_END)
+					raw_flush(raw);
+			} while(status != Z_STREAM_END);
+		}
+	}
+	if(keep)
+		raw_flush(raw);
+	close(raw->fd);
+	if(keep)
+	{
+		if(rename(raw->temp,raw->path) != 0)
+		{
+			fprintf(stderr,"Unable to save raw page %s: %s\n",raw->path,strerror(errno));
+			exit(1);
+		}
+	}
+	else
+		unlink(raw->temp);
+}
+
+/*
+   Create the directories leading to `path`, like mkdir -p
+*/
+static void make_parent_dirs(char *path)
+{
+	char *slash;
+
+	for(slash=strchr(path+1,'/');slash;slash=strchr(slash+1,'/'))
+	{
+		*slash = '\0';
+		if(mkdir(path,0755) != 0 && errno != EEXIST)
+		{
+			fprintf(stderr,"Unable to create %s: %s\n",path,strerror(errno));
+			exit(1);
+		}
+		*slash = '/';
+	}
+}
+
+/*
+   Check that all of a station's pages arrived. A site error sends the
+   error page instead of data; all of a station's pages would be down
+   together, so only the first one is checked for that
+*/
+int page_error(struct page *pages, int channels)
+{
+	int c;
+
+	for(c=0;c<channels;c++)
+		if(pages[c].failed)
+			return(1);
+	return(strstr(pages[0].data.buffer,"error.html") != NULL);
+}
+
+/*
+   Merge one station's pages into a table, one column per channel
+*/
+void write_station(struct page *pages, struct table_output *out, struct resample_options *ro)
+{
+	struct resampler rs;
+	float values[MAX_CHANNELS];
+	long bytes_read,t;
+	int c,output,written;
+
+	/*
+		The value for `bytes_read` is the same for each page; the
+		shortest one is used in case a page was cut off */
+	bytes_read = (long)pages[0].data.size;
+	for(c=1;c<out->channels;c++)
+		if((long)pages[c].data.size < bytes_read)
+			bytes_read = (long)pages[c].data.size;
+
+	/*
+		`output` keeps track of text output, which balances
+		`bytes_read` for input. Because `write_line` for the
+		first page's buffer outputs the same length as input, the
+		numbers track equally, fully dumping all the data in the
+		desired format. */
+	output = 0;
+	if(ro->enabled)
+	{
+		/*
+			Parse the rows instead of copying them, and let the
+			resampler write the grid */
+		resample_init(&rs,ro->step,ro->mode,ro->max_gap,out->channels,write_grid,out);
+		while(output < bytes_read)
+		{
+			written = line_length(pages[0].data.buffer+output);
+			t = parse_timestamp(pages[0].data.buffer+output);
+			if(t >= 0 && (out->end < 0 ||
+					(t % TIMESTAMP_DAY >= out->start && t % TIMESTAMP_DAY < out->end)))
+			{
+				for(c=0;c<out->channels;c++)
+					values[c] = strtof(pages[c].data.buffer+output+VALUE_READ_OFFSET,NULL);
+				resample_push(&rs,t,values);
+			}
+			output += written;
+		}
+		resample_flush(&rs);
+		fprintf(stderr,"%s: resampled %ld rows onto %ld points (%ld s, %s): ",
+				pages[0].station,rs.stats.samples,rs.stats.points,rs.step,
+				resample_mode_name(rs.mode));
+		fprintf(stderr,"%ld gaps, %ld points filled, longest interval %ld s, %ld rows dropped\n",
+				rs.stats.gaps,rs.stats.filled,rs.stats.longest,rs.stats.dropped);
+		return;
+	}
+
+	/* binary rows for crunch_data, see open_ring() */
+	if(out->ring)
+	{
+		while(output < bytes_read)
+		{
+			t = parse_timestamp(pages[0].data.buffer+output);
+			if(t >= 0 && (out->end < 0 ||
+					(t % TIMESTAMP_DAY >= out->start && t % TIMESTAMP_DAY < out->end)))
+			{
+				for(c=0;c<out->channels;c++)
+					values[c] = strtof(pages[c].data.buffer+output+VALUE_READ_OFFSET,NULL);
+				write_ring_row(out,t,values);
+			}
+			output += line_length(pages[0].data.buffer+output);
+		}
+		return;
+	}
+
+	while(output < bytes_read)
+	{
+		if(out->end >= 0)
+		{
+			t = parse_time_of_day(pages[0].data.buffer+output+11);
+			if(t < out->start || t >= out->end)
+			{
+				output += line_length(pages[0].data.buffer+output);
+				continue;
+			}
+		}
+		written = write_line(pages[0].data.buffer+output,0,out->fp);
+		for(c=1;c<out->channels;c++)
+		{
+			putc(' ',out->fp);
+			write_line(pages[c].data.buffer+output,VALUE_READ_OFFSET,out->fp);
+		}
+		if(out->tag)
+			fprintf(out->fp," %s",out->tag);
+		putc('\n',out->fp);
+		output += written;
+	}
+}
+
+/*
+   Merge per-station tables into one, in time order. Rows start with
+   the fixed-width timestamp, so comparing that as text orders them.
+   Rows with the same time keep the station order.
+*/
+void merge_tables(char **table, size_t *size, int n, FILE *fp)
+{
+	size_t pos[MAX_STATIONS];
+	char *row,*end;
+	int s,best;
+
+	memset(pos,0,sizeof(pos));
+	while(1)
+	{
+		best = -1;
+		for(s=0;s<n;s++)
+		{
+			if(table[s] == NULL || pos[s] >= size[s])
+				continue;
+			if(best < 0 || strncmp(table[s]+pos[s],table[best]+pos[best],TIMESTAMP_SIZE-1) < 0)
+				best = s;
+		}
+		if(best < 0)
+			break;
+		row = table[best]+pos[best];
+		end = memchr(row,'\n',size[best]-pos[best]);
+		end = end ? end+1 : table[best]+size[best];
+		fwrite(row,1,end-row,fp);
+		pos[best] += end-row;
+	}
+}
+
+/*
+   output a line of text at a given offset, no \n
+   skip over the CR/LF combo at the end of the line
+   return the number of characters written
+*/
+int write_line(char *text,int offset,FILE *fp)
+{
+	char *temp;
+	
+	temp = text;
+	text += offset;
+	while(isprint(*text))
+	{
+		putc(*text,fp);
+		text++;
+	}
+	text+=2;		/* skip over 0x0d and 0x0a at the end of each line */
+	
+	return(text-temp);
+}
+
+/*
+   return the length of a line of text, including the CR/LF
+   combo at the end, matching the count returned by write_line()
+*/
+int line_length(char *text)
+{
+	char *temp;
+
+	temp = text;
+	while(isprint(*text))
+		text++;
+	text+=2;
+
+	return(text-temp);
+}
+
+/*
+   Callback for the resampler: output a block of grid points
+   in the same format as the merged table
+*/
+void write_grid(const long *t, float * const *v, int n, void *userdata)
+{
+	struct table_output *out;
+	char stamp[TIMESTAMP_SIZE];
+	float values[MAX_CHANNELS];
+	int x,c;
+
+	out = (struct table_output *)userdata;
+	for(x=0;x<n;x++)
+	{
+		if(out->ring)
+		{
+			for(c=0;c<out->channels;c++)
+				values[c] = v[c][x];
+			write_ring_row(out,t[x],values);
+			continue;
+		}
+		format_timestamp(t[x],stamp);
+		fputs(stamp,out->fp);
+		for(c=0;c<out->channels;c++)
+			fprintf(out->fp," %6.2f",v[c][x]);
+		if(out->tag)
+			fprintf(out->fp," %s",out->tag);
+		putc('\n',out->fp);
+	}
+}
+
+/*
+   Put one row into the shared memory ring
+*/
+void write_ring_row(struct table_output *out, long t, const float *v)
+{
+	struct shm_row *row;
+	int c;
+
+	row = shm_ring_slot(out->ring);
+	if(row == NULL)
+	{
+		fprintf(stderr,"The reader of the shared memory rows has gone away.\n");
+		exit(1);
+	}
+	row->t = t;
+	for(c=0;c<out->channels;c++)
+		row->v[c] = v[c];
+	shm_ring_commit(out->ring);
+}
+
+/*
+   Offer the rows through a shared memory ring. Only a single
+   station's table going down a pipe can be handed over this way; it
+   is announced on stdout and given a moment to be claimed.
+   Returns 0 if the reader took it, -1 to write text instead.
+*/
+int open_ring(struct run *run, struct shm_ring *ring)
+{
+	struct stat st;
+
+	if(run->stations != 1 || run->split_dir)
+	{
+		fprintf(stderr,"--shm carries a single station's table only, writing text\n");
+		return(-1);
+	}
+	if(fstat(STDOUT_FILENO,&st) != 0 || !S_ISFIFO(st.st_mode))
+		return(-1);
+	if(shm_ring_create(ring,run->channels) != 0)
+		return(-1);
+	fflush(stdout);
+	if(shm_ring_announce(ring,STDOUT_FILENO) != 0 ||
+			shm_ring_wait_attach(ring,SHM_RING_ATTACH_MS) != 0)
+	{
+		shm_ring_close(ring);
+		return(-1);
+	}
+	return(0);
+}
+
+/*
+   	Output help/about message
+*/
+void show_help(void)
+{
+	puts("fetch_data\nWritten by Dan Gookin, 2015\n");
+	puts("Fetches air temperature, barometric pressure, and wind speed data from");
+	puts("http://lpo.dt.navy.mil/, Acoustic Research Dept. Lake Pend Oreille, ID\n");
+	puts("No options: Fetch current day's data (results may be incomplete)");
+	puts("YYYYMMDD    Fetch data for given date");
+	puts("YYYYMMDD YYYYMMDD");
+	puts("            Fetch data for every day from the first date to the second");
+	puts("--lookahead N");
+	puts("            Download up to N days ahead of the day being written");
+	puts("--shm       Hand the rows to crunch_data in shared memory, not as text");
+	puts("--trace FILE");
+	puts("            Record what each thread does in Chrome trace format");
+	puts("--pool-stats");
+	puts("            Report page buffer and transfer reuse, and peak memory, on stderr");
+	puts("--record FILE");
+	puts("            Keep every response, with its headers and timing, in FILE");
+	puts("--replay FILE, --replay-timed FILE");
+	puts("            Serve the responses kept by --record instead of fetching");
+	puts("            them, as fast as possible or at their recorded pace. The");
+	puts("            --base, --mirror, --station and dates must match");
+	puts("--latency-stats");
+	puts("            Report the transfer and day latency percentiles on stderr");
+	puts("--base URL  Base URL of the site (default " DEFAULT_BASE ")");
+	puts("--template TEMPLATE");
+	puts("            Page address built from {base}, {station}, {year}, {date}");
+	puts("            (YYYY_MM_DD) and {channel}; default " DEFAULT_TEMPLATE);
+	puts("--station ID[,ID...]");
+	puts("            Stations to read (default " DEFAULT_STATION "). With more than");
+	puts("            one, the tables are merged in time order and each row ends");
+	puts("            with its station id");
+	puts("--start HH:MM, --end HH:MM");
+	puts("            Only fetch the rows from --start up to --end, using HTTP");
+	puts("            Range requests");
+	puts("--save-raw DIR");
+	puts("            Also save each page as served, to DIR/STATION/YYYY/YYYY_MM_DD/");
+	puts("            CHANNEL; with --start/--end only the window is saved, as");
+	puts("            CHANNEL.range-FIRST-LAST");
+	puts("--compress  gzip the pages saved by --save-raw");
+	puts("--split DIR Write each station's table to DIR/ID instead of merging");
+	puts("--channels NAME[,NAME...]");
+	puts("            Pages to merge, one column each, in order");
+	puts("            (default " DEFAULT_CHANNELS ")");
+	puts("--mirror URL");
+	puts("            Try this base URL (e.g. http://cache.local/data) before");
+	puts("            --base; may be given more than once");
+	puts("--hedge MS  Duplicate a transfer to the next mirror once it runs longer");
+	puts("            than MS milliseconds, or than the 95th percentile of the");
+	puts("            last few hundred transfers once there are enough (default 5000,");
+	puts("            0 to never hedge). Only with a --mirror to hedge to");
+	puts("--max-transfers N");
+	puts("            Transfers in flight at once, hedges included (default 16)");
+	puts("--timeout SECONDS");
+	puts("            Abandon a transfer after this long (default 300, 0 for none)");
+	puts("--connect-timeout SECONDS");
+	puts("            Abandon a connection attempt after this long (default 30)");
+	puts("--low-speed BYTES:SECONDS");
+	puts("            Abandon a transfer slower than BYTES/s for SECONDS");
+	puts("            (default 1:60)");
+	puts("--resample STEP[:MODE[:MAXGAP]]");
+	puts("            Interpolate onto a grid of STEP seconds; MODE is linear");
+	puts("            (default) or last. Intervals longer than MAXGAP seconds");
+	puts("            (default 2*STEP) are reported as gaps on stderr");
+	puts("--help      Show this message\n");
+	puts("Output is in the format: Date Time Air_temp Bar_press Wind_speed");
+}
@@ -0,0 +1,248 @@
+/*
+	fixture
+	See fixture.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fixture.h"
+
+static int parse_response(struct fixture_response *r, char **next, char *end);
+static char *next_word(char **p);
+static int compare_response(const void *a, const void *b);
+
+/*
+	Start a recording at `path`
+	Returns 0 on success, -1 if the file can't be written.
+*/
+int fixture_record(struct fixture *fx, const char *path)
+{
+	memset(fx,0,sizeof(*fx));
+	fx->fp = fopen(path,"wb");
+	if(fx->fp == NULL)
+		return(-1);
+	pthread_mutex_init(&fx->lock,NULL);
+	fprintf(fx->fp,"%s\n",FIXTURE_TAG);
+	return(0);
+}
+
+/*
+	Add a response to the recording
+*/
+void fixture_write(struct fixture *fx, const struct fixture_response *r)
+{
+	int c;
+
+	pthread_mutex_lock(&fx->lock);
+	fprintf(fx->fp,"response %s %s %d %lu %d %lu %.3f\n",
+			r->url,r->range[0] ? r->range : "-",r->result,(unsigned long)r->header_size,
+			r->chunks,(unsigned long)r->body_size,r->total_ms);
+	fwrite(r->headers,1,r->header_size,fx->fp);
+	for(c=0;c<r->chunks;c++)
+		fprintf(fx->fp,"%.3f %lu\n",r->chunk[c].ms,(unsigned long)r->chunk[c].size);
+	fwrite(r->body,1,r->body_size,fx->fp);
+	putc('\n',fx->fp);
+	pthread_mutex_unlock(&fx->lock);
+}
+
+/*
+	Read a recording made by fixture_record() for replay
+	Returns 0 on success, -1 if the file can't be read or isn't one.
+*/
+int fixture_load(struct fixture *fx, const char *path)
+{
+	FILE *fp;
+	long size;
+	char *p,*end;
+	int capacity;
+	struct fixture_response *grown;
+
+	memset(fx,0,sizeof(*fx));
+	fp = fopen(path,"rb");
+	if(fp == NULL)
+		return(-1);
+	fseek(fp,0,SEEK_END);
+	size = ftell(fp);
+	rewind(fp);
+	fx->text = (char *)malloc(size+1);
+	if(fx->text == NULL || (long)fread(fx->text,1,size,fp) != size)
+	{
+		fclose(fp);
+		return(-1);
+	}
+	fclose(fp);
+	fx->text[size] = '\0';
+	end = fx->text + size;
+	pthread_mutex_init(&fx->lock,NULL);
+
+	p = fx->text;
+	if(strncmp(p,FIXTURE_TAG "\n",strlen(FIXTURE_TAG)+1) != 0)
+		return(-1);
+	p += strlen(FIXTURE_TAG)+1;
+	capacity = 0;
+	while(p < end)
+	{
+		if(fx->responses == capacity)
+		{
+			capacity = capacity ? capacity*2 : 64;
+			grown = (struct fixture_response *)realloc(fx->response,
+					capacity*sizeof(struct fixture_response));
+			if(grown == NULL)
+				return(-1);
+			fx->response = grown;
+		}
+		if(parse_response(&fx->response[fx->responses],&p,end) != 0)
+		{
+			fprintf(stderr,"%s: Improper response %d\n",path,fx->responses+1);
+			return(-1);
+		}
+		fx->response[fx->responses].seq = fx->responses;
+		fx->responses++;
+	}
+	qsort(fx->response,fx->responses,sizeof(struct fixture_response),compare_response);
+	return(0);
+}
+
+/*
+	The next response recorded for `url` and `range`, or the last one
+	once they have all been used; NULL if there is none
+*/
+struct fixture_response *fixture_find(struct fixture *fx, const char *url, const char *range)
+{
+	struct fixture_response key,*r;
+	int lo,hi,mid;
+
+	key.url = (char *)url;
+	key.range = (char *)range;
+	key.seq = -1;
+	/* the first response not before `key` */
+	lo = 0;
+	hi = fx->responses;
+	while(lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if(compare_response(&fx->response[mid],&key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	r = NULL;
+	pthread_mutex_lock(&fx->lock);
+	for(;lo<fx->responses;lo++)
+	{
+		if(strcmp(fx->response[lo].url,url) != 0 || strcmp(fx->response[lo].range,range) != 0)
+			break;
+		r = &fx->response[lo];
+		if(!r->used)
+			break;
+	}
+	if(r)
+		r->used = 1;
+	pthread_mutex_unlock(&fx->lock);
+	return(r);
+}
+
+void fixture_close(struct fixture *fx)
+{
+	int x;
+
+	if(fx->fp)
+		fclose(fx->fp);
+	for(x=0;x<fx->responses;x++)
+		free(fx->response[x].chunk);
+	free(fx->response);
+	free(fx->text);
+	memset(fx,0,sizeof(*fx));
+}
+
+/*
+	Parse the response at *next, pointing the strings into the text,
+	and move *next past it
+*/
+static int parse_response(struct fixture_response *r, char **next, char *end)
+{
+	char *p,*line,*word[8];
+	unsigned long header_size,body_size,size;
+	int w,c;
+
+	p = *next;
+	line = memchr(p,'\n',end-p);
+	if(line == NULL)
+		return(-1);
+	*line = '\0';
+	for(w=0;w<8;w++)
+		if((word[w] = next_word(&p)) == NULL)
+			return(-1);
+	if(strcmp(word[0],"response") != 0)
+		return(-1);
+	r->url = word[1];
+	r->range = strcmp(word[2],"-") == 0 ? "" : word[2];
+	r->result = atoi(word[3]);
+	header_size = strtoul(word[4],NULL,10);
+	r->chunks = atoi(word[5]);
+	body_size = strtoul(word[6],NULL,10);
+	r->total_ms = strtod(word[7],NULL);
+	r->used = 0;
+	p = line + 1;
+
+	if(header_size > (unsigned long)(end-p) || r->chunks < 0)
+		return(-1);
+	r->headers = p;
+	r->header_size = header_size;
+	p += header_size;
+
+	r->chunk = (struct fixture_chunk *)malloc((r->chunks+1)*sizeof(struct fixture_chunk));
+	if(r->chunk == NULL)
+		return(-1);
+	size = 0;
+	for(c=0;c<r->chunks;c++)
+	{
+		line = memchr(p,'\n',end-p);
+		if(line == NULL)
+			return(-1);
+		r->chunk[c].ms = strtod(p,&p);
+		r->chunk[c].size = strtoul(p,NULL,10);
+		size += r->chunk[c].size;
+		p = line + 1;
+	}
+	if(size != body_size || body_size >= (unsigned long)(end-p) || p[body_size] != '\n')
+		return(-1);
+	r->body = p;
+	r->body_size = body_size;
+	*next = p + body_size + 1;
+	return(0);
+}
+
+/*
+	Cut the next space separated word from *p
+*/
+static char *next_word(char **p)
+{
+	char *word;
+
+	word = *p;
+	while(*word == ' ')
+		word++;
+	if(*word == '\0')
+		return(NULL);
+	*p = word;
+	while(**p && **p != ' ')
+		(*p)++;
+	if(**p)
+		*(*p)++ = '\0';
+	return(word);
+}
+
+static int compare_response(const void *a, const void *b)
+{
+	const struct fixture_response *x = a, *y = b;
+	int c;
+
+	if((c = strcmp(x->url,y->url)) != 0)
+		return(c);
+	if((c = strcmp(x->range,y->range)) != 0)
+		return(c);
+	return( (x->seq > y->seq) - (x->seq < y->seq) );
+}
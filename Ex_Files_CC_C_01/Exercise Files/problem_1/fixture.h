@@ -0,0 +1,69 @@
+/*
+	fixture
+	Recorded responses, so fetch_data can be run again offline and get
+	exactly the same pages, delivered the same way.
+
+	A recording keeps, for each transfer that finished, the address and
+	byte range asked for, curl's result, the response headers, the body
+	and when each piece of the body arrived. The file is text lines with
+	the headers and body in between as they were received:
+
+	#fetch_data fixture 1
+	response URL RANGE RESULT HEADER_BYTES CHUNKS BODY_BYTES TOTAL_MS
+	<HEADER_BYTES of headers>
+	MS SIZE						one line per chunk
+	<BODY_BYTES of body>
+
+	RANGE is - for a whole page. A replay looks the response up by
+	address and range; when the same request was recorded more than
+	once, as when a transfer failed and was tried again, the responses
+	are handed out in the order they were recorded.
+
+	Recording and replaying are each safe from several threads.
+*/
+
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define FIXTURE_TAG "#fetch_data fixture 1"
+
+/* a piece of the body as curl delivered it */
+struct fixture_chunk {
+	double ms;					/* since the transfer started */
+	size_t size;
+};
+
+struct fixture_response {
+	char *url;
+	char *range;				/* "" for a whole page */
+	int result;					/* CURLcode */
+	char *headers;
+	size_t header_size;
+	struct fixture_chunk *chunk;
+	int chunks;
+	char *body;
+	size_t body_size;
+	double total_ms;			/* when the transfer ended */
+	long seq;					/* order in the file */
+	int used;					/* replayed already */
+};
+
+struct fixture {
+	pthread_mutex_t lock;
+	FILE *fp;					/* recording to */
+	char *text;					/* replaying: the whole file */
+	struct fixture_response *response;	/* sorted by url, range, seq */
+	int responses;
+};
+
+int fixture_record(struct fixture *fx, const char *path);
+void fixture_write(struct fixture *fx, const struct fixture_response *r);
+int fixture_load(struct fixture *fx, const char *path);
+struct fixture_response *fixture_find(struct fixture *fx, const char *url, const char *range);
+void fixture_close(struct fixture *fx);
+
+#endif
@@ -0,0 +1,612 @@
+/*
+	gen_data
+	Generates synthetic weather data for load testing, in the same
+	format fetch_data writes, for any span of days:
+
+	2015_02_03 09:02:00  38.86   30.07    3.00
+	Date, Time, Air Temperature, Barometric Pressure, Wind Speed
+
+	or, with --pages DIR, as the site's raw channel pages under
+	DIR/{station}/{year}/{date}/{channel}, so the directory can be
+	read by fetch_data as a file:// mirror.
+
+	The data is a seeded random walk that looks like the real thing:
+	each day starts from an anchor (a daily mean that wanders slowly
+	from day to day around a seasonal cycle) and works its way to the
+	next day's anchor by a mean-reverting walk pinned at both ends, with
+	a daily cycle for the air temperature and the wind on top. The same
+	seed gives the same data, whatever the number of threads.
+
+	--gaps PCT drops rows in outages that start at PCT percent of the
+	rows, and --outliers PCT replaces PCT percent of the values with
+	spikes, to exercise the resampler and the robust statistics.
+
+	The anchors are worked out first, one day after another; the days
+	themselves are then independent and are filled by several threads
+	(--threads, default one per processor). Days come back in any order
+	and wait in a reorder buffer, so standard output is always in date
+	order.
+
+	Compile with: cc -o gen_data gen_data.c timestamp.c -lpthread -lm
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "timestamp.h"
+
+#define CHANNELS 3
+#define MAX_THREADS 64
+#define ROW_LINE 43				/* "YYYY_MM_DD HH:MM:SS  38.86   30.07    3.00\n" */
+#define PAGE_LINE 28			/* "YYYY_MM_DD HH:MM:SS  38.86\r\n" */
+#define DEFAULT_STATION "DM"
+
+enum {
+	AIR,
+	BAR,
+	WIND
+};
+
+/* how each channel behaves, in the site's units (F, inHg, mph) */
+struct channel_model {
+	const char *name;			/* page name on the site */
+	float day_phi;				/* day to day persistence of the anchor */
+	float day_sigma;			/* day to day change of the anchor */
+	float theta;				/* mean reversion per row, within a day */
+	float sigma;				/* change per row */
+	float daily;				/* amplitude of the daily cycle */
+	float spike;				/* size of an outlier */
+	float low,high;				/* physical limits */
+};
+
+static const struct channel_model model[CHANNELS] = {
+	{ "Air_Temp", 0.7f, 4.0f, 0.01f, 0.15f, 8.0f, 40.0f, -40.0f, 120.0f },
+	{ "Barometric_Press", 0.8f, 0.08f, 0.005f, 0.004f, 0.0f, 1.5f, 28.0f, 31.5f },
+	{ "Wind_Speed", 0.5f, 1.5f, 0.2f, 0.9f, 2.0f, 30.0f, 0.0f, 80.0f }
+};
+
+struct gen_config {
+	unsigned long seed;
+	long interval;				/* seconds between rows */
+	float gap_rate;				/* chance of an outage starting, per row */
+	float outlier_rate;			/* chance of a spike, per value */
+	int threads;
+	const char *pages_dir;		/* write pages here instead of rows, or NULL */
+	const char *station;
+	long first;					/* midnight of the first day */
+	int days;
+	float *anchor;				/* [days+1][CHANNELS], see make_anchors() */
+};
+
+/* one generated day, as rows or as pages */
+struct day_buffer {
+	char *text;
+	size_t size;
+	size_t capacity;
+};
+
+/* days being generated ahead of output */
+struct generator {
+	struct gen_config *cfg;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;		/* a day is done */
+	pthread_cond_t space;		/* a day has been written, its slot is free */
+	struct day_buffer *slot;	/* day d lives in slot d % slots */
+	int *done;
+	int slots;
+	int next_day;				/* next day for a thread to generate */
+	int next_output;			/* next day to write */
+};
+
+/* per-day random numbers; splitmix64 */
+struct rng {
+	unsigned long state;
+};
+
+void make_anchors(struct gen_config *cfg);
+void *generate_thread(void *arg);
+void generate_day(struct gen_config *cfg, int d, struct day_buffer *buffer);
+void write_pages(struct gen_config *cfg, int d, struct day_buffer *buffer);
+float seasonal(int channel, long t);
+void rng_seed(struct rng *r, unsigned long seed, unsigned long stream);
+unsigned long rng_next(struct rng *r);
+float rng_uniform(struct rng *r);
+float rng_normal(struct rng *r);
+char *put_value(char *p, float v);
+char *put_two(char *p, int n);
+long parse_day(const char *text);
+void make_dirs(char *path);
+
+int main(int argc, char *argv[])
+{
+	struct gen_config cfg;
+	struct generator gen;
+	pthread_t thread[MAX_THREADS];
+	long last;
+	char *date_arg[2];
+	int a,dates,t,d,s;
+
+	/* Read command line parameters */
+	memset(&cfg,0,sizeof(cfg));
+	cfg.seed = 1;
+	cfg.interval = 60;
+	cfg.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	cfg.station = DEFAULT_STATION;
+	dates = 0;
+	for(a=1;a<argc;a++)
+	{
+		if(strcmp(argv[a],"--seed")==0 && a+1<argc)
+			cfg.seed = strtoul(argv[++a],NULL,10);
+		else if(strcmp(argv[a],"--interval")==0 && a+1<argc)
+			cfg.interval = strtol(argv[++a],NULL,10);
+		else if(strcmp(argv[a],"--gaps")==0 && a+1<argc)
+			cfg.gap_rate = strtof(argv[++a],NULL) / 100;
+		else if(strcmp(argv[a],"--outliers")==0 && a+1<argc)
+			cfg.outlier_rate = strtof(argv[++a],NULL) / 100;
+		else if(strcmp(argv[a],"--threads")==0 && a+1<argc)
+			cfg.threads = (int)strtol(argv[++a],NULL,10);
+		else if(strcmp(argv[a],"--pages")==0 && a+1<argc)
+			cfg.pages_dir = argv[++a];
+		else if(strcmp(argv[a],"--station")==0 && a+1<argc)
+			cfg.station = argv[++a];
+		else if(argv[a][0] != '-' && dates < 2)
+			date_arg[dates++] = argv[a];
+		else
+		{
+			puts("gen_data\n");
+			puts("Generates fetch_data style rows for every day from the first date");
+			puts("to the last (default: the first only). Format:\n");
+			puts("gen_data [--seed N] [--interval SEC] [--gaps PCT] [--outliers PCT]");
+			puts("         [--threads N] [--pages DIR [--station ID]] YYYYMMDD [YYYYMMDD]\n");
+			puts("--seed N        Random seed (default 1)");
+			puts("--interval SEC  Seconds between rows (default 60)");
+			puts("--gaps PCT      Start an outage at PCT percent of the rows");
+			puts("--outliers PCT  Make PCT percent of the values spikes");
+			puts("--threads N     Generator threads (default one per processor)");
+			puts("--pages DIR     Write raw pages under DIR/{station}/{year}/{date}/{channel}");
+			puts("--station ID    Station for --pages (default " DEFAULT_STATION ")");
+			return(1);
+		}
+	}
+	if(dates == 0)
+	{
+		fprintf(stderr,"gen_data: No date given, use YYYYMMDD\n");
+		return(1);
+	}
+	if(cfg.interval < 1 || cfg.interval > TIMESTAMP_DAY)
+	{
+		fprintf(stderr,"gen_data: Interval must be from 1 to %ld seconds\n",TIMESTAMP_DAY);
+		return(1);
+	}
+	if(cfg.threads < 1)
+		cfg.threads = 1;
+	if(cfg.threads > MAX_THREADS)
+		cfg.threads = MAX_THREADS;
+	cfg.first = parse_day(date_arg[0]);
+	last = dates == 2 ? parse_day(date_arg[1]) : cfg.first;
+	if(cfg.first < 0 || last < 0)
+	{
+		fprintf(stderr,"gen_data: Improper date format: Use YYYYMMDD\n");
+		return(1);
+	}
+	if(last < cfg.first)
+	{
+		fprintf(stderr,"gen_data: The last date comes before the first\n");
+		return(1);
+	}
+	cfg.days = (int)((last - cfg.first) / TIMESTAMP_DAY) + 1;
+	make_anchors(&cfg);
+
+	/* Generate the days, writing them out in order */
+	memset(&gen,0,sizeof(gen));
+	gen.cfg = &cfg;
+	gen.slots = cfg.threads * 2;
+	gen.slot = calloc(gen.slots,sizeof(struct day_buffer));
+	gen.done = calloc(gen.slots,sizeof(int));
+	if(gen.slot == NULL || gen.done == NULL)
+	{
+		fprintf(stderr,"gen_data: Unable to allocate memory.\n");
+		return(1);
+	}
+	pthread_mutex_init(&gen.lock,NULL);
+	pthread_cond_init(&gen.ready,NULL);
+	pthread_cond_init(&gen.space,NULL);
+	for(t=0;t<cfg.threads;t++)
+	{
+		if(pthread_create(&thread[t],NULL,generate_thread,&gen) != 0)
+		{
+			fprintf(stderr,"gen_data: Unable to start thread.\n");
+			return(1);
+		}
+	}
+	for(d=0;d<cfg.days;d++)
+	{
+		s = d % gen.slots;
+		pthread_mutex_lock(&gen.lock);
+		while(!gen.done[s])
+			pthread_cond_wait(&gen.ready,&gen.lock);
+		pthread_mutex_unlock(&gen.lock);
+
+		/* pages were written by the thread itself */
+		if(cfg.pages_dir == NULL)
+			fwrite(gen.slot[s].text,1,gen.slot[s].size,stdout);
+
+		pthread_mutex_lock(&gen.lock);
+		gen.done[s] = 0;
+		gen.next_output++;
+		pthread_cond_broadcast(&gen.space);
+		pthread_mutex_unlock(&gen.lock);
+	}
+	for(t=0;t<cfg.threads;t++)
+		pthread_join(thread[t],NULL);
+	fflush(stdout);
+
+	for(s=0;s<gen.slots;s++)
+		free(gen.slot[s].text);
+	free(gen.slot);
+	free(gen.done);
+	free(cfg.anchor);
+	return(0);
+}
+
+/*
+	Work out each day's starting values, one day after another: an
+	anomaly that persists from day to day on top of the seasonal mean
+*/
+void make_anchors(struct gen_config *cfg)
+{
+	struct rng r;
+	float anomaly[CHANNELS];
+	long t;
+	int d,c;
+
+	cfg->anchor = malloc((cfg->days+1)*CHANNELS*sizeof(float));
+	if(cfg->anchor == NULL)
+	{
+		fprintf(stderr,"gen_data: Unable to allocate memory.\n");
+		exit(1);
+	}
+	rng_seed(&r,cfg->seed,0);
+	for(c=0;c<CHANNELS;c++)
+		anomaly[c] = 0;
+	for(d=0;d<=cfg->days;d++)
+	{
+		t = cfg->first + d*TIMESTAMP_DAY;
+		for(c=0;c<CHANNELS;c++)
+		{
+			anomaly[c] = model[c].day_phi*anomaly[c] + model[c].day_sigma*rng_normal(&r);
+			cfg->anchor[d*CHANNELS+c] = seasonal(c,t) + anomaly[c];
+		}
+	}
+}
+
+/*
+	Generate days until there are none left. Each thread keeps the
+	buffer of the slot it fills, so they are only allocated once.
+*/
+void *generate_thread(void *arg)
+{
+	struct generator *gen;
+	int d,s;
+
+	gen = (struct generator *)arg;
+	pthread_mutex_lock(&gen->lock);
+	for(;;)
+	{
+		while(gen->next_day < gen->cfg->days && gen->next_day >= gen->next_output + gen->slots)
+			pthread_cond_wait(&gen->space,&gen->lock);
+		if(gen->next_day >= gen->cfg->days)
+			break;
+		d = gen->next_day++;
+		s = d % gen->slots;
+		pthread_mutex_unlock(&gen->lock);
+
+		generate_day(gen->cfg,d,&gen->slot[s]);
+		if(gen->cfg->pages_dir)
+			write_pages(gen->cfg,d,&gen->slot[s]);
+
+		pthread_mutex_lock(&gen->lock);
+		gen->done[s] = 1;
+		pthread_cond_broadcast(&gen->ready);
+	}
+	pthread_mutex_unlock(&gen->lock);
+	return(NULL);
+}
+
+/*
+	Fill `buffer` with day `d`: rows, or the three pages one after the
+	other, each as long as the rows. The walk for each channel starts at
+	zero, mean-reverting, and is pinned to end at zero again by taking
+	off its end point in proportion; the anchors are interpolated across
+	the day underneath it.
+*/
+void generate_day(struct gen_config *cfg, int d, struct day_buffer *buffer)
+{
+	struct rng r;
+	char prefix[TIMESTAMP_SIZE];
+	float *walk[CHANNELS],v[CHANNELS],a0,a1,frac,cycle;
+	long rows,i,secs,outage;
+	size_t need;
+	char *p,*page[CHANNELS];
+	int c;
+
+	rows = TIMESTAMP_DAY / cfg->interval;
+	need = cfg->pages_dir ? rows*PAGE_LINE*CHANNELS : rows*ROW_LINE;
+	if(buffer->capacity < need)
+	{
+		free(buffer->text);
+		buffer->text = malloc(need);
+		buffer->capacity = need;
+		if(buffer->text == NULL)
+		{
+			fprintf(stderr,"gen_data: Unable to allocate memory.\n");
+			exit(1);
+		}
+	}
+	walk[0] = malloc(rows*CHANNELS*sizeof(float));
+	if(walk[0] == NULL)
+	{
+		fprintf(stderr,"gen_data: Unable to allocate memory.\n");
+		exit(1);
+	}
+	for(c=1;c<CHANNELS;c++)
+		walk[c] = walk[0] + c*rows;
+
+	/* the day's own stream, so threads don't change the result */
+	rng_seed(&r,cfg->seed,(unsigned long)d+1);
+	for(c=0;c<CHANNELS;c++)
+	{
+		walk[c][0] = 0;
+		for(i=1;i<rows;i++)
+			walk[c][i] = walk[c][i-1]*(1-model[c].theta) + model[c].sigma*rng_normal(&r);
+		for(i=1;i<rows;i++)
+			walk[c][i] -= walk[c][rows-1] * (float)i / (float)(rows-1 ? rows-1 : 1);
+	}
+
+	format_timestamp(cfg->first + d*TIMESTAMP_DAY,prefix);
+	p = buffer->text;
+	for(c=0;c<CHANNELS;c++)
+		page[c] = buffer->text + c*rows*PAGE_LINE;
+	outage = 0;
+	for(i=0;i<rows;i++)
+	{
+		/* an outage takes out a run of rows */
+		if(outage > 0)
+		{
+			outage--;
+			continue;
+		}
+		if(cfg->gap_rate > 0 && rng_uniform(&r) < cfg->gap_rate)
+		{
+			outage = 1 + (long)(rng_uniform(&r) * 60);
+			continue;
+		}
+
+		secs = i*cfg->interval;
+		frac = (float)secs / (float)TIMESTAMP_DAY;
+		/* warmest and windiest mid-afternoon */
+		cycle = -cosf(2*(float)M_PI*(frac - 0.125f));
+		for(c=0;c<CHANNELS;c++)
+		{
+			a0 = cfg->anchor[d*CHANNELS+c];
+			a1 = cfg->anchor[(d+1)*CHANNELS+c];
+			v[c] = a0 + (a1-a0)*frac + walk[c][i] + model[c].daily*cycle;
+			if(cfg->outlier_rate > 0 && rng_uniform(&r) < cfg->outlier_rate)
+				v[c] += rng_uniform(&r) < 0.5f ? -model[c].spike : model[c].spike;
+			if(v[c] < model[c].low)
+				v[c] = model[c].low;
+			if(v[c] > model[c].high)
+				v[c] = model[c].high;
+		}
+
+		/* "YYYY_MM_DD HH:MM:SS" without the cost of printf() */
+		put_two(prefix+11,(int)(secs/3600));
+		put_two(prefix+14,(int)(secs/60%60));
+		put_two(prefix+17,(int)(secs%60));
+		if(cfg->pages_dir)
+		{
+			for(c=0;c<CHANNELS;c++)
+			{
+				memcpy(page[c],prefix,19);
+				*(page[c]+19) = ' ';
+				page[c] = put_value(page[c]+20,v[c]);
+				*page[c]++ = '\r';
+				*page[c]++ = '\n';
+			}
+		}
+		else
+		{
+			memcpy(p,prefix,19);
+			p += 19;
+			*p++ = ' ';
+			p = put_value(p,v[AIR]);
+			*p++ = ' ';
+			*p++ = ' ';
+			p = put_value(p,v[BAR]);
+			*p++ = ' ';
+			*p++ = ' ';
+			p = put_value(p,v[WIND]);
+			*p++ = '\n';
+		}
+	}
+	if(cfg->pages_dir)
+	{
+		/* each page is as long as the rows written, so they line up */
+		buffer->size = page[0] - buffer->text;
+	}
+	else
+		buffer->size = p - buffer->text;
+	free(walk[0]);
+}
+
+/*
+	Save day `d`'s pages in the site's layout
+*/
+void write_pages(struct gen_config *cfg, int d, struct day_buffer *buffer)
+{
+	char path[FILENAME_MAX],stamp[TIMESTAMP_SIZE];
+	long rows;
+	FILE *fp;
+	int c;
+
+	rows = TIMESTAMP_DAY / cfg->interval;
+	format_timestamp(cfg->first + d*TIMESTAMP_DAY,stamp);
+	for(c=0;c<CHANNELS;c++)
+	{
+		snprintf(path,sizeof(path),"%s/%s/%.4s/%.10s/%s",
+				cfg->pages_dir,cfg->station,stamp,stamp,model[c].name);
+		make_dirs(path);
+		fp = fopen(path,"w");
+		if(fp == NULL)
+		{
+			fprintf(stderr,"gen_data: Unable to write %s\n",path);
+			exit(1);
+		}
+		fwrite(buffer->text + c*rows*PAGE_LINE,1,buffer->size,fp);
+		fclose(fp);
+	}
+}
+
+/*
+	The long-term mean of a channel at time `t`: a yearly cycle for the
+	air temperature, coldest in mid January
+*/
+float seasonal(int channel, long t)
+{
+	float year;
+
+	switch(channel)
+	{
+		case AIR:
+			year = (float)(t % (365*TIMESTAMP_DAY + TIMESTAMP_DAY/4)) / (365.25f*TIMESTAMP_DAY);
+			return(48.0f - 22.0f*cosf(2*(float)M_PI*(year - 0.04f)));
+		case BAR:
+			return(30.0f);
+		default:
+			return(5.0f);
+	}
+}
+
+/*
+	Start `r` on stream `stream` of `seed`: the anchors are stream 0 and
+	day d is stream d+1. The seed and then the stream are put through
+	the mixer, so each stream starts at an unrelated point rather than
+	further along one shared sequence.
+*/
+void rng_seed(struct rng *r, unsigned long seed, unsigned long stream)
+{
+	r->state = seed;
+	r->state = rng_next(r) ^ stream;
+	r->state = rng_next(r);
+}
+
+unsigned long rng_next(struct rng *r)
+{
+	unsigned long z;
+
+	z = (r->state += 0x9e3779b97f4a7c15UL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+	return(z ^ (z >> 31));
+}
+
+/* from 0 up to 1 */
+float rng_uniform(struct rng *r)
+{
+	return((float)(rng_next(r) >> 40) / 16777216.0f);
+}
+
+/*
+	Near enough normal, mean 0 and deviation 1: the sum of four
+	uniforms, scaled. Much cheaper than logs and square roots.
+*/
+float rng_normal(struct rng *r)
+{
+	unsigned long z;
+	float sum;
+
+	z = rng_next(r);
+	sum = (float)(z & 0xffff) + (float)((z >> 16) & 0xffff)
+			+ (float)((z >> 32) & 0xffff) + (float)(z >> 48);
+	return((sum / 65536.0f - 2.0f) * 1.7320508f);
+}
+
+/*
+	Write `v` as printf("%6.2f") would, for values from -99.99 to
+	999.99. Returns the position after it.
+*/
+char *put_value(char *p, float v)
+{
+	long cents;
+	int negative,x;
+	char digits[8];
+
+	negative = v < 0;
+	cents = lrintf(negative ? -v*100 : v*100);
+	x = 0;
+	do
+	{
+		digits[x++] = '0' + cents % 10;
+		cents /= 10;
+	} while(cents > 0 || x < 3);
+	if(negative)
+		digits[x++] = '-';
+	while(x < 5)
+		digits[x++] = ' ';
+	/* digits[] is backwards: the point goes before the last two */
+	*p++ = digits[4];
+	*p++ = digits[3];
+	*p++ = digits[2];
+	*p++ = '.';
+	*p++ = digits[1];
+	*p++ = digits[0];
+	return(p);
+}
+
+char *put_two(char *p, int n)
+{
+	*p++ = '0' + n/10;
+	*p++ = '0' + n%10;
+	return(p);
+}
+
+/*
+	Convert a YYYYMMDD argument to the time of that day's midnight,
+	-1 if it isn't a date
+*/
+long parse_day(const char *text)
+{
+	char stamp[TIMESTAMP_SIZE];
+	int a;
+
+	for(a=0;a<8;a++)
+		if(!isdigit(text[a]))
+			return(-1);
+	snprintf(stamp,sizeof(stamp),"%.4s_%.2s_%.2s 00:00:00",text,text+4,text+6);
+	return(parse_timestamp(stamp));
+}
+
+/*
+	Create the directories leading to `path`
+*/
+void make_dirs(char *path)
+{
+	char *slash;
+
+	for(slash=strchr(path+1,'/');slash;slash=strchr(slash+1,'/'))
+	{
+		*slash = '\0';
+		if(mkdir(path,0755) != 0 && errno != EEXIST)
+		{
+			fprintf(stderr,"gen_data: Unable to create %s\n",path);
+			exit(1);
+		}
+		*slash = '/';
+	}
+}
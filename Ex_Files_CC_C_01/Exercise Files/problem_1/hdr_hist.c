@@ -0,0 +1,131 @@
+/*
+	hdr_hist
+	See hdr_hist.h
+*/
+
+#include <string.h>
+#include "hdr_hist.h"
+
+#define HDR_HALF (HDR_SUB_COUNT/2)
+#define HDR_LIMIT ((1L << HDR_MAX_BITS) - 1)
+
+static int hdr_index(long us);
+static long hdr_highest(int index);
+
+void hdr_init(struct hdr_hist *h)
+{
+	memset(h,0,sizeof(*h));
+}
+
+/*
+	Count one value, clamped to the range the histogram covers
+*/
+void hdr_record(struct hdr_hist *h, long us)
+{
+	if(us < 0)
+		us = 0;
+	if(us > HDR_LIMIT)
+		us = HDR_LIMIT;
+	h->count[hdr_index(us)]++;
+	if(h->total == 0 || us < h->min)
+		h->min = us;
+	if(us > h->max)
+		h->max = us;
+	h->total++;
+	h->sum += us;
+}
+
+/*
+	Add the counts of `from` to `into`
+*/
+void hdr_merge(struct hdr_hist *into, const struct hdr_hist *from)
+{
+	int x;
+
+	if(from->total == 0)
+		return;
+	for(x=0;x<HDR_COUNTS;x++)
+		into->count[x] += from->count[x];
+	if(into->total == 0 || from->min < into->min)
+		into->min = from->min;
+	if(from->max > into->max)
+		into->max = from->max;
+	into->total += from->total;
+	into->sum += from->sum;
+}
+
+/*
+	The value `pct` percent of the recorded values are at or below,
+	as the top of its bucket, so never understated; 0 when empty
+*/
+long hdr_percentile(const struct hdr_hist *h, double pct)
+{
+	long target,seen,value;
+	int x;
+
+	if(h->total == 0)
+		return(0);
+	if(pct >= 100)
+		return(h->max);
+	target = (long)(pct / 100 * h->total + 0.999999);
+	if(target < 1)
+		target = 1;
+	seen = 0;
+	for(x=0;x<HDR_COUNTS;x++)
+	{
+		seen += h->count[x];
+		if(seen >= target)
+			break;
+	}
+	value = hdr_highest(x);
+	return(value < h->max ? value : h->max);
+}
+
+/*
+	Write the count, mean and tail percentiles in milliseconds, as a
+	line of text or as a JSON member named `name`
+*/
+void hdr_report(FILE *fp, const struct hdr_hist *h, const char *name, int json)
+{
+	double mean;
+
+	mean = h->total ? h->sum / h->total : 0;
+	if(json)
+	{
+		fprintf(fp,"\"%s\": { \"count\": %ld, \"meanMs\": %.3f, \"p50Ms\": %.3f, \"p90Ms\": %.3f, ",
+				name,h->total,mean/1e3,hdr_percentile(h,50)/1e3,hdr_percentile(h,90)/1e3);
+		fprintf(fp,"\"p99Ms\": %.3f, \"p999Ms\": %.3f, \"maxMs\": %.3f }",
+				hdr_percentile(h,99)/1e3,hdr_percentile(h,99.9)/1e3,h->max/1e3);
+		return;
+	}
+	fprintf(fp,"%s: %ld, mean %.3f ms, p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f ms\n",
+			name,h->total,mean/1e3,hdr_percentile(h,50)/1e3,hdr_percentile(h,90)/1e3,
+			hdr_percentile(h,99)/1e3,hdr_percentile(h,99.9)/1e3,h->max/1e3);
+}
+
+/*
+	The bucket of a value: exact below HDR_SUB_COUNT, then HDR_HALF
+	buckets per power of two
+*/
+static int hdr_index(long us)
+{
+	int bucket;
+
+	bucket = 63 - __builtin_clzl((unsigned long)us | 1) - (HDR_SUB_BITS - 1);
+	if(bucket < 0)
+		bucket = 0;
+	return(bucket * HDR_HALF + (int)(us >> bucket));
+}
+
+/*
+	The largest value that falls in bucket `index`
+*/
+static long hdr_highest(int index)
+{
+	int bucket;
+	long sub;
+
+	bucket = index < HDR_SUB_COUNT ? 0 : index / HDR_HALF - 1;
+	sub = index - bucket * HDR_HALF;
+	return(((sub + 1) << bucket) - 1);
+}
@@ -0,0 +1,43 @@
+/*
+	hdr_hist
+	A high dynamic range histogram of latencies, after Gil Tene's
+	HdrHistogram: fixed memory, constant time to record, and percentiles
+	to within 1% from a microsecond to days.
+
+	Values are whole microseconds. Below HDR_SUB_COUNT each value has a
+	bucket of its own; above it every power of two is split into
+	HDR_SUB_COUNT/2 equal buckets, so a bucket is never wider than 1/128
+	of the values in it. Counting is all there is to recording, so two
+	histograms are merged by adding their counts: each thread can record
+	into one of its own and hand it over when it's done.
+
+	A histogram isn't locked; one shared between threads needs a lock
+	of its own.
+*/
+
+#ifndef HDR_HIST_H
+#define HDR_HIST_H
+
+#include <stdio.h>
+
+#define HDR_SUB_BITS 8
+#define HDR_SUB_COUNT (1 << HDR_SUB_BITS)		/* 256 */
+#define HDR_MAX_BITS 40							/* up to 2^40 us, 12 days */
+#define HDR_BUCKETS (HDR_MAX_BITS - HDR_SUB_BITS + 1)
+#define HDR_COUNTS ((HDR_BUCKETS + 1) * (HDR_SUB_COUNT/2))
+
+struct hdr_hist {
+	long count[HDR_COUNTS];
+	long total;				/* values recorded */
+	long min;				/* exact, us */
+	long max;
+	double sum;
+};
+
+void hdr_init(struct hdr_hist *h);
+void hdr_record(struct hdr_hist *h, long us);
+void hdr_merge(struct hdr_hist *into, const struct hdr_hist *from);
+long hdr_percentile(const struct hdr_hist *h, double pct);
+void hdr_report(FILE *fp, const struct hdr_hist *h, const char *name, int json);
+
+#endif
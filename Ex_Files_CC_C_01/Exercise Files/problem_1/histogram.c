@@ -0,0 +1,88 @@
+/*
+	histogram
+	See histogram.h
+*/
+
+#include <stdlib.h>
+#include "histogram.h"
+
+/*
+	Parse a `BINS[:MIN:MAX]` specification, e.g. "20" or "20:-10:40".
+	Returns 0 with just the bins, 1 with the range too, -1 if the
+	specification is malformed.
+*/
+int histogram_parse(const char *spec, int *bins, float *min, float *max)
+{
+	char *end;
+
+	*bins = (int)strtol(spec,&end,10);
+	if(end == spec || *bins < 1 || *bins > HISTOGRAM_MAX_BINS)
+		return(-1);
+	if(*end == '\0')
+		return(0);
+	if(*end != ':')
+		return(-1);
+	spec = end+1;
+	*min = strtof(spec,&end);
+	if(end == spec || *end != ':')
+		return(-1);
+	spec = end+1;
+	*max = strtof(spec,&end);
+	if(end == spec || *end != '\0' || !(*max > *min))
+		return(-1);
+	return(1);
+}
+
+/*
+	Returns 0 on success, -1 if the counts can't be allocated
+*/
+int histogram_init(struct histogram *h, int bins, float min, float max)
+{
+	h->bins = bins;
+	h->min = min;
+	h->max = max;
+	h->scale = bins / (max - min);
+	h->total = 0;
+	h->count = (long *)calloc(bins+2,sizeof(long));
+	return(h->count ? 0 : -1);
+}
+
+/*
+	Count `n` values, `stride` floats apart
+*/
+void histogram_add(struct histogram *h, const float *v, int n, int stride)
+{
+	float value[HISTOGRAM_BLOCK];
+	int bin[HISTOGRAM_BLOCK];
+	float f,top,offset;
+	int x,count;
+
+	top = (float)(h->bins + 1);
+	/* one bin up, so below `min` is bin 0 and never negative */
+	offset = 1.0f - h->min * h->scale;
+	for(;n>0;n-=count,v+=count*stride)
+	{
+		count = n < HISTOGRAM_BLOCK ? n : HISTOGRAM_BLOCK;
+		for(x=0;x<count;x++)
+			value[x] = v[x*stride];
+		for(;x<HISTOGRAM_BLOCK;x++)
+			value[x] = 0.0f;
+		/* always a whole block, which the vectoriser likes best */
+		for(x=0;x<HISTOGRAM_BLOCK;x++)
+		{
+			f = value[x] * h->scale + offset;
+			f = f > 0.0f ? f : 0.0f;		/* NaN too */
+			f = f < top ? f : top;
+			bin[x] = (int)f;
+		}
+		for(x=0;x<count;x++)
+			h->count[bin[x]]++;
+		h->total += count;
+	}
+}
+
+void histogram_free(struct histogram *h)
+{
+	free(h->count);
+	h->count = NULL;
+}
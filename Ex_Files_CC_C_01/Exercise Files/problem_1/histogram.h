@@ -0,0 +1,33 @@
+/*
+	histogram
+	Counts of values in equal width bins, built up a block of values at
+	a time as they stream past, so nothing needs to be kept.
+
+	The values are gathered HISTOGRAM_BLOCK at a time and the bin of
+	each worked out first, in a loop of fixed length with no branches
+	or calls that the compiler turns into vector code at -O2; the
+	counts are then added one by one. Bin 0 and bin `bins`+1 count the
+	values below `min` and at or above `max` (and NaN, as below).
+*/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#define HISTOGRAM_BLOCK 256		/* values binned at a time */
+#define HISTOGRAM_MAX_BINS 10000
+
+struct histogram {
+	int bins;
+	float min;
+	float max;
+	float scale;				/* bins per unit */
+	long *count;				/* bins+2: below, the bins, above */
+	long total;
+};
+
+int histogram_parse(const char *spec, int *bins, float *min, float *max);
+int histogram_init(struct histogram *h, int bins, float min, float max);
+void histogram_add(struct histogram *h, const float *v, int n, int stride);
+void histogram_free(struct histogram *h);
+
+#endif
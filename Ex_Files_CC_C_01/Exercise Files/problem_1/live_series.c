@@ -0,0 +1,115 @@
+/*
+	live_series
+	See live_series.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "live_series.h"
+
+/*
+	Returns 0 on success, -1 if the directory can't be allocated
+*/
+int live_series_init(struct live_series *s, int k)
+{
+	memset(s,0,sizeof(*s));
+	s->k = k;
+	s->chunk = (struct live_chunk **)calloc(LIVE_MAX_CHUNKS,sizeof(struct live_chunk *));
+	if(s->chunk == NULL)
+		return(-1);
+	atomic_init(&s->length,0);
+	return(0);
+}
+
+/*
+	Writer: add `n` rows, row r having time t[r] and values v[r*k ..
+	r*k+k-1], and publish them together
+	Returns 0 on success, -1 if a chunk can't be allocated or the store
+	is full, in which case none of the rows are published.
+*/
+int live_series_append(struct live_series *s, const long *t, const float *v, int n)
+{
+	struct live_chunk *chunk;
+	long i,slot;
+	int r,c;
+
+	for(r=0;r<n;r++)
+	{
+		i = s->written + r;
+		slot = i & (LIVE_CHUNK_ROWS-1);
+		if(slot == 0)
+		{
+			if((i >> LIVE_CHUNK_BITS) >= LIVE_MAX_CHUNKS)
+				return(-1);
+			/* unpublished, so no reader can be looking */
+			if(s->chunk[i >> LIVE_CHUNK_BITS] == NULL)
+				s->chunk[i >> LIVE_CHUNK_BITS] = (struct live_chunk *)malloc(
+						offsetof(struct live_chunk,v) + s->k*sizeof(chunk->v[0]));
+			if(s->chunk[i >> LIVE_CHUNK_BITS] == NULL)
+				return(-1);
+		}
+		chunk = s->chunk[i >> LIVE_CHUNK_BITS];
+		chunk->t[slot] = t[r];
+		for(c=0;c<s->k;c++)
+			chunk->v[c][slot] = v[r*s->k+c];
+	}
+	s->written += n;
+	atomic_store_explicit(&s->length,s->written,memory_order_release);
+	return(0);
+}
+
+/*
+	The first of rows [0,length) at or after time `t`; `length` if none
+*/
+long live_series_find(const struct live_series *s, long t, long length)
+{
+	long lo,hi,mid;
+
+	lo = 0;
+	hi = length;
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo)/2;
+		if(live_series_time(s,mid) < t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return(lo);
+}
+
+/*
+	The mean of column `c` over rows [from,to), a chunk at a time; 0
+	for no rows
+*/
+double live_series_mean(const struct live_series *s, int c, long from, long to)
+{
+	const float *v;
+	double total;
+	long i,end;
+
+	if(to <= from)
+		return(0);
+	total = 0;
+	for(i=from;i<to;i=end)
+	{
+		end = (i | (LIVE_CHUNK_ROWS-1)) + 1;
+		if(end > to)
+			end = to;
+		v = &s->chunk[i >> LIVE_CHUNK_BITS]->v[c][i & (LIVE_CHUNK_ROWS-1)];
+		for(;i<end;i++)
+			total += *v++;
+	}
+	return(total / (to - from));
+}
+
+void live_series_free(struct live_series *s)
+{
+	long x;
+
+	for(x=0;x<LIVE_MAX_CHUNKS && s->chunk[x];x++)
+		free(s->chunk[x]);
+	free(s->chunk);
+	memset(s,0,sizeof(*s));
+}
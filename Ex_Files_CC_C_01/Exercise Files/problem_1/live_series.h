@@ -0,0 +1,68 @@
+/*
+	live_series
+	Rows kept in memory as they arrive, for any number of threads to
+	read while they're still being added, without locks.
+
+	The rows are stored by column in chunks of LIVE_CHUNK_ROWS, each
+	with room for only the k columns in use, found through a directory
+	of chunk pointers that is allocated once and never moves, so a row
+	never moves once written. The writer fills
+	rows beyond the published length, then publishes them all at once
+	by storing the new length with release ordering. A reader loads the
+	length with acquire ordering: every row below it, and the chunk
+	pointer leading to it, was written before the store, so the reader
+	sees all of them whole. The length it loaded is its snapshot; rows
+	added after are simply not in it.
+
+	There is one writer. Several threads adding rows have to take turns
+	among themselves; readers never wait and never make the writer
+	wait. Rows are expected in time order, which live_series_find()
+	relies on. The store is freed only when no reader is left.
+*/
+
+#ifndef LIVE_SERIES_H
+#define LIVE_SERIES_H
+
+#include <stdatomic.h>
+
+#define LIVE_SERIES_MAX 8				/* values per row */
+#define LIVE_CHUNK_BITS 12
+#define LIVE_CHUNK_ROWS (1L << LIVE_CHUNK_BITS)
+#define LIVE_MAX_CHUNKS 65536			/* 268 million rows */
+
+struct live_chunk {
+	long t[LIVE_CHUNK_ROWS];
+	float v[LIVE_SERIES_MAX][LIVE_CHUNK_ROWS];
+};
+
+struct live_series {
+	int k;
+	struct live_chunk **chunk;			/* LIVE_MAX_CHUNKS long */
+	long written;						/* the writer's own count */
+	atomic_long length;					/* rows published */
+};
+
+int live_series_init(struct live_series *s, int k);
+int live_series_append(struct live_series *s, const long *t, const float *v, int n);
+long live_series_find(const struct live_series *s, long t, long length);
+double live_series_mean(const struct live_series *s, int c, long from, long to);
+void live_series_free(struct live_series *s);
+
+/* a reader's snapshot: the rows below this are there to be read */
+static inline long live_series_length(struct live_series *s)
+{
+	return(atomic_load_explicit(&s->length,memory_order_acquire));
+}
+
+/* row i's time and value of column c; i must be below a snapshot */
+static inline long live_series_time(const struct live_series *s, long i)
+{
+	return(s->chunk[i >> LIVE_CHUNK_BITS]->t[i & (LIVE_CHUNK_ROWS-1)]);
+}
+
+static inline float live_series_value(const struct live_series *s, long i, int c)
+{
+	return(s->chunk[i >> LIVE_CHUNK_BITS]->v[c][i & (LIVE_CHUNK_ROWS-1)]);
+}
+
+#endif
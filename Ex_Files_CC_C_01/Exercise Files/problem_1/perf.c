@@ -0,0 +1,149 @@
+/*
+	perf
+	See perf.h
+*/
+
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "perf.h"
+
+struct perf_counters perf = { .stage = -1 };
+
+static const char *stage_names[PERF_STAGES] = {
+	"read", "split", "parse", "aggregate", "median", "output"
+};
+
+static double wall_now(void);
+static double cpu_now(void);
+
+/*
+	Turn the counters on. Nothing is charged to a stage until the
+	first perf_enter().
+*/
+void perf_start(void)
+{
+	perf.enabled = 1;
+	perf.stage = -1;
+	hdr_init(&perf.batches);
+}
+
+/*
+	Charge the time since the last switch to the current stage and
+	start timing `stage`, -1 for none. Returns the stage closed.
+*/
+int perf_switch(int stage)
+{
+	double wall,cpu;
+	int previous;
+
+	wall = wall_now();
+	cpu = cpu_now();
+	previous = perf.stage;
+	if(previous >= 0)
+	{
+		perf.wall[previous] += wall - perf.wall_mark;
+		perf.cpu[previous] += cpu - perf.cpu_mark;
+	}
+	perf.stage = stage;
+	perf.wall_mark = wall;
+	perf.cpu_mark = cpu;
+	return(previous);
+}
+
+/*
+	Close the current stage
+*/
+void perf_stop(void)
+{
+	if(perf.enabled)
+		perf_switch(-1);
+}
+
+/*
+	The wall clock, seconds
+*/
+double perf_now(void)
+{
+	return(wall_now());
+}
+
+/*
+	Record the latency of a batch that began at `started`, from
+	perf_now()
+*/
+void perf_batch(double started)
+{
+	if(perf.enabled)
+		hdr_record(&perf.batches,(long)((wall_now() - started) * 1e6));
+}
+
+/*
+	Write the counters to `fp`, as text or as a JSON object
+*/
+void perf_report(FILE *fp, int json)
+{
+	struct rusage usage;
+	double wall,cpu;
+	int s;
+
+	wall = cpu = 0;
+	for(s=0;s<PERF_STAGES;s++)
+	{
+		wall += perf.wall[s];
+		cpu += perf.cpu[s];
+	}
+	if(wall <= 0)
+		wall = 1e-9;
+	getrusage(RUSAGE_SELF,&usage);
+
+	if(json)
+	{
+		fprintf(fp,"{ \"rows\": %ld, \"bytes\": %ld, \"wallSeconds\": %.6f, \"cpuSeconds\": %.6f,\n",
+				perf.rows,perf.bytes,wall,cpu);
+		fprintf(fp,"  \"rowsPerSecond\": %.0f, \"bytesPerSecond\": %.0f,\n",
+				perf.rows/wall,perf.bytes/wall);
+		fprintf(fp,"  \"stages\": {");
+		for(s=0;s<PERF_STAGES;s++)
+			fprintf(fp,"%s \"%s\": { \"wallSeconds\": %.6f, \"cpuSeconds\": %.6f }",
+					s ? "," : "",stage_names[s],perf.wall[s],perf.cpu[s]);
+		fprintf(fp," },\n");
+		fprintf(fp,"  \"allocations\": %ld, \"allocatedBytes\": %ld, \"peakRssKiB\": %ld,\n  ",
+				perf.allocs,perf.alloc_bytes,usage.ru_maxrss);
+		hdr_report(fp,&perf.batches,"batchLatency",1);
+		if(perf.cache)
+			fprintf(fp,",\n  \"cache\": \"%s\"",perf.cache);
+		fprintf(fp," }\n");
+		return;
+	}
+
+	fprintf(fp,"Statistics\n");
+	fprintf(fp,"\tRows\t%ld\t%.0f rows/s\n",perf.rows,perf.rows/wall);
+	fprintf(fp,"\tBytes\t%ld\t%.0f bytes/s\n",perf.bytes,perf.bytes/wall);
+	fprintf(fp,"\tStage\t\tWall ms\t\tCPU ms\n");
+	for(s=0;s<PERF_STAGES;s++)
+		fprintf(fp,"\t%-10s\t%10.3f\t%10.3f\n",stage_names[s],perf.wall[s]*1e3,perf.cpu[s]*1e3);
+	fprintf(fp,"\t%-10s\t%10.3f\t%10.3f\n","total",wall*1e3,cpu*1e3);
+	fprintf(fp,"\tAllocations\t%ld\t%ld bytes\n",perf.allocs,perf.alloc_bytes);
+	fprintf(fp,"\tPeak RSS\t%ld KiB\n",usage.ru_maxrss);
+	fprintf(fp,"\t");
+	hdr_report(fp,&perf.batches,"Batch latency",0);
+	if(perf.cache)
+		fprintf(fp,"\tCache\t%s\n",perf.cache);
+}
+
+static double wall_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return(now.tv_sec + now.tv_nsec/1e9);
+}
+
+static double cpu_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&now);
+	return(now.tv_sec + now.tv_nsec/1e9);
+}
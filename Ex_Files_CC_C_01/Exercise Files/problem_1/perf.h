@@ -0,0 +1,74 @@
+/*
+	perf
+	Performance counters for crunch_data's --stats report: wall and
+	CPU time for each stage of the work, rows and bytes handled,
+	allocations made and the peak resident set size, and the latency of
+	each batch of rows, from being split to being stored, as percentiles
+	from an HDR histogram (see hdr_hist.h).
+
+	The time is charged to one stage at a time. perf_enter() closes the
+	current stage and opens another, returning the one it closed so a
+	nested piece of work can hand the time back when it's done:
+
+	prev = perf_enter(PERF_MEDIAN);
+	...
+	perf_enter(prev);
+
+	Stages are switched per block of rows, not per row. While the
+	counters are disabled perf_enter() is a test of one flag.
+*/
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "hdr_hist.h"
+
+enum perf_stage {
+	PERF_READ,				/* waiting for input */
+	PERF_SPLIT,				/* finding the rows in it */
+	PERF_PARSE,				/* converting the rows to numbers */
+	PERF_AGGREGATE,			/* storing and resampling them, means */
+	PERF_MEDIAN,			/* the selections: median, trimmed mean, MAD */
+	PERF_OUTPUT,			/* writing the report */
+	PERF_STAGES
+};
+
+struct perf_counters {
+	int enabled;
+	int stage;				/* being timed, -1 for none */
+	double wall_mark;		/* when it started */
+	double cpu_mark;
+	double wall[PERF_STAGES];	/* seconds */
+	double cpu[PERF_STAGES];
+	long rows;
+	long bytes;
+	long allocs;
+	long alloc_bytes;
+	struct hdr_hist batches;	/* split to stored, per batch */
+	const char *cache;		/* "hit" or "miss" with --cache, else NULL */
+};
+
+extern struct perf_counters perf;
+
+void perf_start(void);
+int perf_switch(int stage);
+void perf_stop(void);
+void perf_report(FILE *fp, int json);
+double perf_now(void);
+void perf_batch(double started);
+
+static inline int perf_enter(int stage)
+{
+	return(perf.enabled ? perf_switch(stage) : -1);
+}
+
+/* count an allocation of `bytes`; cheap enough to always be done */
+static inline void perf_alloc(size_t bytes)
+{
+	perf.allocs++;
+	perf.alloc_bytes += bytes;
+}
+
+#endif
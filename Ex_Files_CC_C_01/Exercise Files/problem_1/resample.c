@@ -0,0 +1,207 @@
+/*
+	resample
+	See resample.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "resample.h"
+
+static void emit_segment(struct resampler *r, long t, const float *v, int in_gap);
+static void fill_linear(float *out, int n, float base, float slope, float x0, float dx);
+static void fill_constant(float *out, int n, float value);
+static void emit_block(struct resampler *r);
+
+/*
+	Parse a `STEP[:MODE[:MAXGAP]]` specification, e.g. "60", "60:last"
+	or "300:linear:900". The gap threshold defaults to twice the step.
+	Returns 0 on success, -1 if the specification is malformed.
+*/
+int resample_parse(const char *spec, long *step, int *mode, long *max_gap)
+{
+	char *end;
+
+	*step = strtol(spec,&end,10);
+	if(end == spec || *step <= 0)
+		return(-1);
+	*mode = RESAMPLE_LINEAR;
+	*max_gap = 2 * *step;
+	if(*end == '\0')
+		return(0);
+	if(*end != ':')
+		return(-1);
+	spec = end+1;
+	if(strncmp(spec,"linear",6) == 0)
+		spec += 6;
+	else if(strncmp(spec,"last",4) == 0)
+	{
+		*mode = RESAMPLE_LAST;
+		spec += 4;
+	}
+	else
+		return(-1);
+	if(*spec == '\0')
+		return(0);
+	if(*spec != ':')
+		return(-1);
+	*max_gap = strtol(spec+1,&end,10);
+	if(end == spec+1 || *end != '\0' || *max_gap <= 0)
+		return(-1);
+	return(0);
+}
+
+void resample_init(struct resampler *r, long step, int mode, long max_gap,
+		int columns, resample_emit emit, void *userdata)
+{
+	int c;
+
+	memset(r,0,sizeof(*r));
+	r->step = step;
+	r->mode = mode;
+	r->max_gap = max_gap;
+	r->columns = columns > RESAMPLE_MAX_COLUMNS ? RESAMPLE_MAX_COLUMNS : columns;
+	r->emit = emit;
+	r->userdata = userdata;
+	for(c=0;c<RESAMPLE_MAX_COLUMNS;c++)
+		r->column[c] = r->v[c];
+}
+
+/*
+	Accept the sample `v` taken at time `t`, producing every grid point
+	in [previous sample, t)
+*/
+void resample_push(struct resampler *r, long t, const float *v)
+{
+	long interval,offset;
+	int c,in_gap;
+
+	if(!r->primed)
+	{
+		r->primed = 1;
+		r->prev_t = t;
+		/* first grid point at or after the first sample */
+		offset = t % r->step;
+		if(offset < 0)
+			offset += r->step;
+		r->next = offset ? t - offset + r->step : t;
+		for(c=0;c<r->columns;c++)
+			r->prev_v[c] = v[c];
+		r->stats.samples++;
+		return;
+	}
+	if(t <= r->prev_t)
+	{
+		r->stats.dropped++;
+		return;
+	}
+
+	interval = t - r->prev_t;
+	if(interval > r->stats.longest)
+		r->stats.longest = interval;
+	in_gap = interval > r->max_gap;
+	if(in_gap)
+		r->stats.gaps++;
+
+	emit_segment(r,t,v,in_gap);
+
+	r->prev_t = t;
+	for(c=0;c<r->columns;c++)
+		r->prev_v[c] = v[c];
+	r->stats.samples++;
+}
+
+/*
+	Emit the final grid point (if the last sample sits on the grid) and
+	anything still held in the output block
+*/
+void resample_flush(struct resampler *r)
+{
+	int c;
+
+	if(r->primed && r->next == r->prev_t)
+	{
+		r->t[r->count] = r->next;
+		for(c=0;c<r->columns;c++)
+			r->v[c][r->count] = r->prev_v[c];
+		r->count++;
+		r->stats.points++;
+		r->next += r->step;
+	}
+	if(r->count > 0)
+		emit_block(r);
+}
+
+const char *resample_mode_name(int mode)
+{
+	return(mode == RESAMPLE_LAST ? "last" : "linear");
+}
+
+/*
+	Produce the grid points between the previous sample and the one at
+	`t`. Points are written a column at a time into the block so the
+	kernels below run over contiguous memory and vectorise.
+*/
+static void emit_segment(struct resampler *r, long t, const float *v, int in_gap)
+{
+	long remaining,x;
+	int n,c;
+	float slope,span;
+
+	if(r->next >= t)
+		return;
+	remaining = (t - 1 - r->next) / r->step + 1;
+	span = (float)(t - r->prev_t);
+
+	while(remaining > 0)
+	{
+		n = RESAMPLE_BLOCK - r->count;
+		if(n > remaining)
+			n = (int)remaining;
+		for(x=0;x<n;x++)
+			r->t[r->count+x] = r->next + x * r->step;
+		for(c=0;c<r->columns;c++)
+		{
+			if(r->mode == RESAMPLE_LINEAR)
+			{
+				slope = (v[c] - r->prev_v[c]) / span;
+				fill_linear(r->v[c]+r->count,n,r->prev_v[c],slope,
+						(float)(r->next - r->prev_t),(float)r->step);
+			}
+			else
+				fill_constant(r->v[c]+r->count,n,r->prev_v[c]);
+		}
+		r->count += n;
+		r->next += n * r->step;
+		r->stats.points += n;
+		if(in_gap)
+			r->stats.filled += n;
+		remaining -= n;
+		if(r->count == RESAMPLE_BLOCK)
+			emit_block(r);
+	}
+}
+
+/*
+	out[k] = base + slope * (x0 + k*dx)
+*/
+static void fill_linear(float *out, int n, float base, float slope, float x0, float dx)
+{
+	int k;
+
+	for(k=0;k<n;k++)
+		out[k] = base + slope * (x0 + dx * (float)k);
+}
+
+static void fill_constant(float *out, int n, float value)
+{
+	int k;
+
+	for(k=0;k<n;k++)
+		out[k] = value;
+}
+
+static void emit_block(struct resampler *r)
+{
+	r->emit(r->t,r->column,r->count,r->userdata);
+	r->count = 0;
+}
@@ -0,0 +1,72 @@
+/*
+	resample
+	Puts irregularly sampled rows onto a uniform time grid in one
+	streaming pass. Shared by fetch_data (on the merged pages) and
+	crunch_data (on its standard input).
+
+	Rows are pushed in time order. Grid points are aligned to multiples
+	of the step (a 60 second grid lands on whole minutes) and are handed
+	to the `emit` callback in blocks of up to RESAMPLE_BLOCK rows, one
+	contiguous array per column. Each column is either interpolated
+	linearly between the surrounding samples or holds the last value.
+	Nothing is extrapolated past the first or last sample.
+
+	Intervals between samples longer than `max_gap` are counted as gaps.
+	Grid points inside a gap are still filled, but tallied separately so
+	the caller can report how much of the output was invented.
+*/
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdio.h>
+
+#define RESAMPLE_MAX_COLUMNS 8
+#define RESAMPLE_BLOCK 256
+#define RESAMPLE_DEFAULT_STEP 60
+
+enum resample_mode {
+	RESAMPLE_LINEAR,
+	RESAMPLE_LAST
+};
+
+struct resample_gaps {
+	long samples;			/* input rows accepted */
+	long dropped;			/* rows out of time order or duplicated */
+	long points;			/* grid points emitted */
+	long gaps;				/* intervals longer than max_gap */
+	long filled;			/* grid points emitted inside a gap */
+	long longest;			/* longest interval seen, seconds */
+};
+
+typedef void (*resample_emit)(const long *t, float * const *v, int n, void *userdata);
+
+struct resampler {
+	long step;
+	long max_gap;
+	int mode;
+	int columns;
+	resample_emit emit;
+	void *userdata;
+	/* previous sample */
+	int primed;
+	long prev_t;
+	float prev_v[RESAMPLE_MAX_COLUMNS];
+	/* next grid point to be produced */
+	long next;
+	/* output block */
+	int count;
+	long t[RESAMPLE_BLOCK];
+	float v[RESAMPLE_MAX_COLUMNS][RESAMPLE_BLOCK];
+	float *column[RESAMPLE_MAX_COLUMNS];
+	struct resample_gaps stats;
+};
+
+int resample_parse(const char *spec, long *step, int *mode, long *max_gap);
+void resample_init(struct resampler *r, long step, int mode, long max_gap,
+		int columns, resample_emit emit, void *userdata);
+void resample_push(struct resampler *r, long t, const float *v);
+void resample_flush(struct resampler *r);
+const char *resample_mode_name(int mode);
+
+#endif
@@ -0,0 +1,119 @@
+/*
+	running_median
+	See running_median.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "running_median.h"
+
+static int heap_push(struct float_heap *h, float v);
+static float heap_pop(struct float_heap *h);
+
+void running_median_init(struct running_median *m)
+{
+	memset(m,0,sizeof(*m));
+}
+
+/*
+	Take in one value
+	Returns 0 on success, -1 if a heap can't grow.
+*/
+int running_median_add(struct running_median *m, float v)
+{
+	if(v != v)
+		return(0);				/* NaN */
+	if(m->lower.count == 0 || v <= -m->lower.v[0])
+	{
+		if(heap_push(&m->lower,-v) != 0)
+			return(-1);
+	}
+	else if(heap_push(&m->upper,v) != 0)
+		return(-1);
+
+	/* the lower half holds the middle value, or one of the two */
+	if(m->lower.count > m->upper.count + 1)
+		return(heap_push(&m->upper,-heap_pop(&m->lower)));
+	if(m->upper.count > m->lower.count)
+		return(heap_push(&m->lower,-heap_pop(&m->upper)));
+	return(0);
+}
+
+/*
+	The median of the values so far, 0 if there are none
+*/
+float running_median_get(const struct running_median *m)
+{
+	if(m->lower.count == 0)
+		return(0);
+	if(m->lower.count > m->upper.count)
+		return(-m->lower.v[0]);						/* odd */
+	return( (-m->lower.v[0] + m->upper.v[0]) / 2 );	/* even */
+}
+
+long running_median_count(const struct running_median *m)
+{
+	return((long)m->lower.count + m->upper.count);
+}
+
+void running_median_free(struct running_median *m)
+{
+	free(m->lower.v);
+	free(m->upper.v);
+	memset(m,0,sizeof(*m));
+}
+
+/*
+	Add a value, doubling the heap when it's full
+*/
+static int heap_push(struct float_heap *h, float v)
+{
+	float *grown;
+	int i,parent;
+
+	if(h->count == h->capacity)
+	{
+		h->capacity = h->capacity ? h->capacity*2 : 1024;
+		grown = (float *)realloc(h->v,h->capacity*sizeof(float));
+		if(grown == NULL)
+			return(-1);
+		h->v = grown;
+	}
+	/* sift up */
+	i = h->count++;
+	while(i > 0)
+	{
+		parent = (i - 1) / 2;
+		if(h->v[parent] <= v)
+			break;
+		h->v[i] = h->v[parent];
+		i = parent;
+	}
+	h->v[i] = v;
+	return(0);
+}
+
+/*
+	Remove and return the smallest value; the heap mustn't be empty
+*/
+static float heap_pop(struct float_heap *h)
+{
+	float top,last;
+	int i,child;
+
+	top = h->v[0];
+	last = h->v[--h->count];
+	/* sift the last value down from the root */
+	i = 0;
+	while((child = 2*i + 1) < h->count)
+	{
+		if(child + 1 < h->count && h->v[child+1] < h->v[child])
+			child++;
+		if(last <= h->v[child])
+			break;
+		h->v[i] = h->v[child];
+		i = child;
+	}
+	h->v[i] = last;
+	return(top);
+}
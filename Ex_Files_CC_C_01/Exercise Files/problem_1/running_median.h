@@ -0,0 +1,37 @@
+/*
+	running_median
+	The median of the values so far, kept up to date as each one is
+	added, for a report that's redone as more rows come in.
+
+	The values are split into two binary heaps: the lower half, with
+	its largest value at the root, and the upper half, with its
+	smallest at the root. Adding a value puts it in the half it belongs
+	to and, if that half has become too big, moves one root across, so
+	it costs log n swaps; the median is read off the roots. The lower
+	half is kept negated so both heaps are min-heaps. As with
+	get_median(), an even count gives the mean of the two middle
+	values. NaNs are ignored.
+*/
+
+#ifndef RUNNING_MEDIAN_H
+#define RUNNING_MEDIAN_H
+
+/* a min-heap of floats */
+struct float_heap {
+	float *v;
+	int count;
+	int capacity;
+};
+
+struct running_median {
+	struct float_heap lower;		/* negated, so -lower.v[0] is its largest */
+	struct float_heap upper;
+};
+
+void running_median_init(struct running_median *m);
+int running_median_add(struct running_median *m, float v);
+float running_median_get(const struct running_median *m);
+long running_median_count(const struct running_median *m);
+void running_median_free(struct running_median *m);
+
+#endif
@@ -0,0 +1,341 @@
+/*
+	shm_ring
+	See shm_ring.h
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shm_ring.h"
+
+#define SHM_RING_MAGIC 0x52494e47		/* "RING" */
+#define SHM_RING_POLL_MS 100			/* how often a sleeper checks its peer */
+
+enum {
+	ATTACH_WAITING,
+	ATTACH_CLAIMED,
+	ATTACH_REFUSED
+};
+
+/* at the start of the shared memory, followed by the rows */
+struct shm_ring_header {
+	unsigned magic;
+	int columns;
+	pid_t writer;
+	pid_t reader;
+	atomic_int attached;			/* ATTACH_*, settled by compare-and-swap */
+	atomic_int closed;				/* writer is done */
+	atomic_ulong head;				/* rows published */
+	atomic_ulong tail;				/* rows the reader is done with */
+	atomic_uint data_seq;			/* futex words, bumped on every change */
+	atomic_uint space_seq;
+	atomic_int reader_waiting;
+	atomic_int writer_waiting;
+};
+
+static void futex_wait(atomic_uint *word, unsigned seen, int ms);
+static void futex_wake(atomic_uint *word);
+static int peer_gone(pid_t pid);
+static void publish(struct shm_ring *ring);
+
+/*
+	Create an empty ring for rows of `columns` values
+	Returns 0 on success, -1 if shared memory is not available.
+*/
+int shm_ring_create(struct shm_ring *ring, int columns)
+{
+	struct shm_ring_header *h;
+
+	memset(ring,0,sizeof(*ring));
+	if(columns > SHM_RING_COLUMNS)
+		return(-1);
+	ring->size = sizeof(struct shm_ring_header) + SHM_RING_ROWS*sizeof(struct shm_row);
+	ring->fd = memfd_create("shm-ring",0);
+	if(ring->fd < 0)
+		return(-1);
+	if(ftruncate(ring->fd,ring->size) != 0)
+	{
+		close(ring->fd);
+		return(-1);
+	}
+	h = mmap(NULL,ring->size,PROT_READ|PROT_WRITE,MAP_SHARED,ring->fd,0);
+	if(h == MAP_FAILED)
+	{
+		close(ring->fd);
+		return(-1);
+	}
+	ring->header = h;
+	ring->rows = (struct shm_row *)(h+1);
+	h->magic = SHM_RING_MAGIC;
+	h->columns = columns;
+	h->writer = getpid();
+	atomic_init(&h->attached,ATTACH_WAITING);
+	return(0);
+}
+
+/*
+	Write the announcement line to `fd`, normally standard output
+	Returns 0 on success, -1 if it can't be written.
+*/
+int shm_ring_announce(struct shm_ring *ring, int fd)
+{
+	char line[64];
+	int n;
+
+	n = snprintf(line,sizeof(line),"%s %ld %d\n",SHM_RING_TAG,(long)getpid(),ring->fd);
+	return(write(fd,line,n) == n ? 0 : -1);
+}
+
+/*
+	Wait up to `ms` milliseconds for a reader to claim the ring
+	Returns 0 if one did. Otherwise the ring is refused, so a late
+	reader falls back to text, and -1 is returned.
+*/
+int shm_ring_wait_attach(struct shm_ring *ring, int ms)
+{
+	struct shm_ring_header *h;
+	unsigned seq;
+	int expected,waited;
+
+	h = ring->header;
+	for(waited=0;waited<ms;waited+=SHM_RING_POLL_MS)
+	{
+		seq = atomic_load(&h->space_seq);
+		if(atomic_load(&h->attached) == ATTACH_CLAIMED)
+			break;
+		futex_wait(&h->space_seq,seq,SHM_RING_POLL_MS);
+	}
+	expected = ATTACH_WAITING;
+	if(atomic_compare_exchange_strong(&h->attached,&expected,ATTACH_REFUSED))
+		return(-1);
+	ring->peer = h->reader;
+	return(0);
+}
+
+/*
+	Return the next free row for the writer to fill, waiting for the
+	reader to make room if the ring is full. The row becomes visible
+	after shm_ring_commit(). Returns NULL if the reader has gone away.
+*/
+struct shm_row *shm_ring_slot(struct shm_ring *ring)
+{
+	struct shm_ring_header *h;
+	unsigned seq;
+
+	h = ring->header;
+	while(ring->next - atomic_load_explicit(&h->tail,memory_order_acquire) >= SHM_RING_ROWS)
+	{
+		/* the reader can't drain what it hasn't been shown */
+		publish(ring);
+		atomic_store(&h->writer_waiting,1);
+		seq = atomic_load(&h->space_seq);
+		if(ring->next - atomic_load(&h->tail) >= SHM_RING_ROWS)
+		{
+			if(peer_gone(ring->peer))
+			{
+				atomic_store(&h->writer_waiting,0);
+				return(NULL);
+			}
+			futex_wait(&h->space_seq,seq,SHM_RING_POLL_MS);
+		}
+		atomic_store(&h->writer_waiting,0);
+	}
+	return(&ring->rows[ring->next & (SHM_RING_ROWS-1)]);
+}
+
+/*
+	Count the row from shm_ring_slot() as filled, publishing a batch
+*/
+void shm_ring_commit(struct shm_ring *ring)
+{
+	ring->next++;
+	if(ring->next - ring->published >= SHM_RING_BATCH)
+		publish(ring);
+}
+
+/*
+	Publish the last rows, tell the reader there are no more and
+	release the writer's mapping
+*/
+void shm_ring_close(struct shm_ring *ring)
+{
+	struct shm_ring_header *h;
+
+	h = ring->header;
+	publish(ring);
+	atomic_store(&h->closed,1);
+	atomic_fetch_add(&h->data_seq,1);
+	futex_wake(&h->data_seq);
+	munmap(h,ring->size);
+	close(ring->fd);
+	ring->header = NULL;
+}
+
+/*
+	Claim the ring named by an announcement line, for rows of at least
+	`columns` values. Returns 0 on success, -1 if the line is not an
+	announcement, the ring can't be mapped or the writer gave up on it.
+*/
+int shm_ring_attach(struct shm_ring *ring, const char *announcement, int columns)
+{
+	struct shm_ring_header *h;
+	char path[64];
+	long pid;
+	int fd,expected;
+
+	memset(ring,0,sizeof(*ring));
+	if(strncmp(announcement,SHM_RING_TAG " ",sizeof(SHM_RING_TAG)) != 0)
+		return(-1);
+	if(sscanf(announcement+sizeof(SHM_RING_TAG),"%ld %d",&pid,&fd) != 2)
+		return(-1);
+	snprintf(path,sizeof(path),"/proc/%ld/fd/%d",pid,fd);
+	ring->fd = open(path,O_RDWR);
+	if(ring->fd < 0)
+		return(-1);
+	ring->size = sizeof(struct shm_ring_header) + SHM_RING_ROWS*sizeof(struct shm_row);
+	h = mmap(NULL,ring->size,PROT_READ|PROT_WRITE,MAP_SHARED,ring->fd,0);
+	if(h == MAP_FAILED)
+	{
+		close(ring->fd);
+		return(-1);
+	}
+	ring->header = h;
+	ring->rows = (struct shm_row *)(h+1);
+	if(h->magic != SHM_RING_MAGIC || h->writer != (pid_t)pid || h->columns < columns)
+	{
+		shm_ring_detach(ring);
+		return(-1);
+	}
+	h->reader = getpid();
+	expected = ATTACH_WAITING;
+	if(!atomic_compare_exchange_strong(&h->attached,&expected,ATTACH_CLAIMED))
+	{
+		shm_ring_detach(ring);
+		return(-1);
+	}
+	ring->peer = h->writer;
+	atomic_fetch_add(&h->space_seq,1);
+	futex_wake(&h->space_seq);
+	return(0);
+}
+
+/*
+	Wait for rows and point `rows` at them, in place in the ring
+	Returns how many follow on without wrapping around, or 0 once the
+	writer has closed the ring (or died) and every row has been read.
+	Hand them back with shm_ring_release() when done.
+*/
+long shm_ring_read(struct shm_ring *ring, struct shm_row **rows)
+{
+	struct shm_ring_header *h;
+	unsigned long head,tail,start;
+	unsigned seq;
+	long n;
+
+	h = ring->header;
+	tail = atomic_load_explicit(&h->tail,memory_order_relaxed);
+	for(;;)
+	{
+		head = atomic_load_explicit(&h->head,memory_order_acquire);
+		if(head != tail)
+			break;
+		if(atomic_load(&h->closed))
+		{
+			/* the last rows may have been published just before */
+			head = atomic_load_explicit(&h->head,memory_order_acquire);
+			if(head != tail)
+				break;
+			return(0);
+		}
+		atomic_store(&h->reader_waiting,1);
+		seq = atomic_load(&h->data_seq);
+		if(atomic_load(&h->head) == tail && !atomic_load(&h->closed))
+		{
+			if(peer_gone(ring->peer))
+			{
+				atomic_store(&h->reader_waiting,0);
+				return(0);
+			}
+			futex_wait(&h->data_seq,seq,SHM_RING_POLL_MS);
+		}
+		atomic_store(&h->reader_waiting,0);
+	}
+
+	start = tail & (SHM_RING_ROWS-1);
+	n = (long)(head - tail);
+	if(start + n > SHM_RING_ROWS)
+		n = SHM_RING_ROWS - start;
+	*rows = &ring->rows[start];
+	return(n);
+}
+
+/*
+	Hand `n` rows back to the writer
+*/
+void shm_ring_release(struct shm_ring *ring, long n)
+{
+	struct shm_ring_header *h;
+
+	h = ring->header;
+	atomic_fetch_add_explicit(&h->tail,n,memory_order_release);
+	atomic_fetch_add(&h->space_seq,1);
+	if(atomic_load(&h->writer_waiting))
+		futex_wake(&h->space_seq);
+}
+
+void shm_ring_detach(struct shm_ring *ring)
+{
+	munmap(ring->header,ring->size);
+	close(ring->fd);
+	ring->header = NULL;
+}
+
+/*
+	Make the filled rows visible to the reader, waking it if it sleeps
+*/
+static void publish(struct shm_ring *ring)
+{
+	struct shm_ring_header *h;
+
+	if(ring->published == ring->next)
+		return;
+	h = ring->header;
+	atomic_store_explicit(&h->head,ring->next,memory_order_release);
+	ring->published = ring->next;
+	atomic_fetch_add(&h->data_seq,1);
+	if(atomic_load(&h->reader_waiting))
+		futex_wake(&h->data_seq);
+}
+
+/*
+	Sleep while `*word` still holds `seen`, for at most `ms` milliseconds.
+	The futexes are shared between processes, so not FUTEX_PRIVATE.
+*/
+static void futex_wait(atomic_uint *word, unsigned seen, int ms)
+{
+	struct timespec timeout;
+
+	timeout.tv_sec = ms / 1000;
+	timeout.tv_nsec = (ms % 1000) * 1000000L;
+	syscall(SYS_futex,word,FUTEX_WAIT,seen,&timeout,NULL,0);
+}
+
+static void futex_wake(atomic_uint *word)
+{
+	syscall(SYS_futex,word,FUTEX_WAKE,1,NULL,NULL,0);
+}
+
+static int peer_gone(pid_t pid)
+{
+	return(pid > 0 && kill(pid,0) != 0 && errno == ESRCH);
+}
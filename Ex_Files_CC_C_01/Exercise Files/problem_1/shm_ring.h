@@ -0,0 +1,67 @@
+/*
+	shm_ring
+	Hands rows from fetch_data to crunch_data through shared memory
+	instead of as text through the pipe between them.
+
+	The writer creates the ring in an anonymous memory file (memfd) and
+	announces it as the first line of its standard output:
+
+	#shm-ring PID FD
+
+	A reader at the other end of the pipe maps the same memory through
+	/proc/PID/fd/FD and claims the ring. If no reader claims it within
+	SHM_RING_ATTACH_MS, e.g. the output goes to a file or some other
+	program, the writer keeps to text and the reader, finding the ring
+	gone or already refused, reads the text that follows the line.
+
+	Rows are binary: a timestamp and up to SHM_RING_COLUMNS values. The
+	writer fills them in place and publishes them in batches of
+	SHM_RING_BATCH; the reader uses them where they lie and hands the
+	space back. Each side only sleeps on a futex when the ring is empty
+	(or full), and is only woken if it said it was sleeping.
+*/
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SHM_RING_TAG "#shm-ring"
+#define SHM_RING_COLUMNS 8
+#define SHM_RING_ROWS 65536			/* a power of two */
+#define SHM_RING_BATCH 256
+#define SHM_RING_ATTACH_MS 2000
+
+struct shm_row {
+	long t;							/* seconds, see timestamp.h */
+	float v[SHM_RING_COLUMNS];
+};
+
+struct shm_ring_header;
+
+struct shm_ring {
+	int fd;
+	struct shm_ring_header *header;
+	struct shm_row *rows;
+	size_t size;					/* bytes mapped */
+	unsigned long next;				/* writer: rows filled, published or not */
+	unsigned long published;
+	pid_t peer;						/* process at the other end */
+};
+
+/* writer */
+int shm_ring_create(struct shm_ring *ring, int columns);
+int shm_ring_announce(struct shm_ring *ring, int fd);
+int shm_ring_wait_attach(struct shm_ring *ring, int ms);
+struct shm_row *shm_ring_slot(struct shm_ring *ring);
+void shm_ring_commit(struct shm_ring *ring);
+void shm_ring_close(struct shm_ring *ring);
+
+/* reader */
+int shm_ring_attach(struct shm_ring *ring, const char *announcement, int columns);
+long shm_ring_read(struct shm_ring *ring, struct shm_row **rows);
+void shm_ring_release(struct shm_ring *ring, long n);
+void shm_ring_detach(struct shm_ring *ring);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+	timestamp
+	See timestamp.h
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include "timestamp.h"
+
+static long days_from_civil(long y, int m, int d);
+static void civil_from_days(long z, long *y, int *m, int *d);
+static int read_digits(const char *text, int count);
+
+/*
+	Convert a `YYYY_MM_DD HH:MM:SS` stamp to seconds since the epoch
+	Any single character may separate the fields. Returns -1 when the
+	stamp is malformed.
+*/
+long parse_timestamp(const char *text)
+{
+	int x,year,month,day,hour,minute,second;
+
+	/* never read past the end of a short string */
+	for(x=0;x<TIMESTAMP_SIZE-1;x++)
+		if(*(text+x) == '\0')
+			return(-1);
+
+	if((year = read_digits(text,4)) < 0 ||
+		(month = read_digits(text+5,2)) < 1 || month > 12 ||
+		(day = read_digits(text+8,2)) < 1 || day > 31 ||
+		(hour = read_digits(text+11,2)) < 0 || hour > 23 ||
+		(minute = read_digits(text+14,2)) < 0 || minute > 59 ||
+		(second = read_digits(text+17,2)) < 0 || second > 60)
+		return(-1);
+
+	return( days_from_civil(year,month,day)*TIMESTAMP_DAY +
+			hour*3600L + minute*60L + second);
+}
+
+/*
+	Write `t` into `text` as `YYYY_MM_DD HH:MM:SS`
+	`text` must hold at least TIMESTAMP_SIZE characters
+*/
+void format_timestamp(long t, char *text)
+{
+	long days,secs,year;
+	int month,day;
+
+	days = t / TIMESTAMP_DAY;
+	secs = t % TIMESTAMP_DAY;
+	if(secs < 0)
+	{
+		secs += TIMESTAMP_DAY;
+		days--;
+	}
+	civil_from_days(days,&year,&month,&day);
+	snprintf(text,TIMESTAMP_SIZE,"%04u_%02d_%02d %02d:%02d:%02d",
+			(unsigned)year % 10000,month,day,
+			(int)secs/3600,(int)secs/60%60,(int)secs%60);
+}
+
+/*
+	Days since 1970-01-01 in the proleptic Gregorian calendar
+	(Howard Hinnant's days_from_civil algorithm)
+*/
+static long days_from_civil(long y, int m, int d)
+{
+	long era,yoe,doy,doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y-399) / 400;
+	yoe = y - era * 400;
+	doy = (153*(m + (m > 2 ? -3 : 9)) + 2)/5 + d-1;
+	doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+	return(era * 146097 + doe - 719468);
+}
+
+/*
+	Inverse of days_from_civil()
+*/
+static void civil_from_days(long z, long *y, int *m, int *d)
+{
+	long era,doe,yoe,doy,mp;
+
+	z += 719468;
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = z - era * 146097;
+	yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+	doy = doe - (365*yoe + yoe/4 - yoe/100);
+	mp = (5*doy + 2)/153;
+	*d = (int)(doy - (153*mp+2)/5 + 1);
+	*m = (int)(mp < 10 ? mp+3 : mp-9);
+	*y = yoe + era * 400 + (*m <= 2);
+}
+
+/*
+	Read `count` decimal digits, -1 if any of them is not a digit
+*/
+static int read_digits(const char *text, int count)
+{
+	int x,value;
+
+	value = 0;
+	for(x=0;x<count;x++)
+	{
+		if(!isdigit((unsigned char)*(text+x)))
+			return(-1);
+		value = value*10 + *(text+x) - '0';
+	}
+	return(value);
+}
@@ -0,0 +1,20 @@
+/*
+	timestamp
+	Conversion between the `YYYY_MM_DD HH:MM:SS` stamps that start every
+	row of the Lake Pend Oreille pages and seconds since 1970-01-01.
+
+	The stamps carry no time zone, so they are treated as UTC and the
+	arithmetic is done by hand rather than through mktime(), which would
+	apply the host's local time zone and DST rules.
+*/
+
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#define TIMESTAMP_SIZE 20		/* "YYYY_MM_DD HH:MM:SS" plus '\0' */
+#define TIMESTAMP_DAY 86400L
+
+long parse_timestamp(const char *text);
+void format_timestamp(long t, char *text);
+
+#endif
@@ -0,0 +1,231 @@
+/*
+	trace
+	See trace.h
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+#define TRACE_CHUNK 4096		/* events per allocation */
+#define TRACE_DETAIL 96
+
+struct trace_event {
+	char phase;					/* 'X' span, 'b' async span, 'M' thread name */
+	const char *cat;
+	const char *name;
+	double start;				/* microseconds */
+	double end;
+	unsigned long id;			/* async spans */
+	char detail[TRACE_DETAIL];
+};
+
+struct trace_chunk {
+	struct trace_chunk *next;
+	int count;
+	struct trace_event event[TRACE_CHUNK];
+};
+
+/* one per thread, only ever written by that thread */
+struct trace_buffer {
+	struct trace_buffer *next;	/* in the shared list */
+	long tid;
+	struct trace_chunk *first;
+	struct trace_chunk *last;
+};
+
+int trace_enabled;
+static char *trace_path;
+static double trace_origin;		/* the clock when tracing started */
+static _Atomic(struct trace_buffer *) buffers;
+static __thread struct trace_buffer *local;
+
+static struct trace_buffer *thread_buffer(void);
+static void write_string(FILE *fp, const char *text);
+
+/*
+	Start recording, to be written to `path` at exit
+	Returns 0 on success, -1 if the path can't be kept.
+*/
+int trace_open(const char *path)
+{
+	trace_path = strdup(path);
+	if(trace_path == NULL)
+		return(-1);
+	trace_origin = 0;
+	trace_origin = trace_clock();
+	trace_enabled = 1;
+	atexit(trace_close);
+	return(0);
+}
+
+double trace_clock(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return(now.tv_sec * 1e6 + now.tv_nsec / 1e3);
+}
+
+/*
+	Append an event to the calling thread's buffer
+*/
+void trace_record(char phase, const char *cat, const char *name, double start, double end,
+		unsigned long id, const char *detail)
+{
+	struct trace_buffer *b;
+	struct trace_chunk *chunk;
+	struct trace_event *e;
+
+	b = thread_buffer();
+	if(b == NULL)
+		return;
+	chunk = b->last;
+	if(chunk == NULL || chunk->count == TRACE_CHUNK)
+	{
+		chunk = (struct trace_chunk *)malloc(sizeof(struct trace_chunk));
+		if(chunk == NULL)
+			return;				/* lose the event rather than the run */
+		chunk->next = NULL;
+		chunk->count = 0;
+		if(b->last)
+			b->last->next = chunk;
+		else
+			b->first = chunk;
+		b->last = chunk;
+	}
+	e = &chunk->event[chunk->count];
+	e->phase = phase;
+	e->cat = cat;
+	e->name = name;
+	e->start = start;
+	e->end = end;
+	e->id = id;
+	if(detail)
+		snprintf(e->detail,TRACE_DETAIL,"%s",detail);
+	else
+		e->detail[0] = '\0';
+	/* the event is only read at exit, after the threads are done */
+	chunk->count++;
+}
+
+/*
+	Name the calling thread in the trace
+*/
+void trace_thread_name(const char *name)
+{
+	if(trace_enabled)
+		trace_record('M',"__metadata","thread_name",0,0,0,name);
+}
+
+/*
+	Write every thread's events to the trace file, once
+*/
+void trace_close(void)
+{
+	struct trace_buffer *b;
+	struct trace_chunk *chunk;
+	struct trace_event *e;
+	FILE *fp;
+	long pid;
+	int x,first;
+
+	if(!trace_enabled)
+		return;
+	trace_enabled = 0;
+	fp = fopen(trace_path,"w");
+	if(fp == NULL)
+	{
+		fprintf(stderr,"Unable to write trace to %s\n",trace_path);
+		return;
+	}
+	pid = (long)getpid();
+	first = 1;
+	fprintf(fp,"{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	for(b=atomic_load(&buffers);b;b=b->next)
+	{
+		for(chunk=b->first;chunk;chunk=chunk->next)
+		{
+			for(x=0;x<chunk->count;x++)
+			{
+				e = &chunk->event[x];
+				fprintf(fp,"%s{ \"pid\": %ld, \"tid\": %ld, \"cat\": \"%s\", \"name\": \"%s\", ",
+						first ? "" : ",\n",pid,b->tid,e->cat,e->name);
+				first = 0;
+				if(e->phase == 'M')
+				{
+					fprintf(fp,"\"ph\": \"M\", \"args\": { \"name\": ");
+					write_string(fp,e->detail);
+					fprintf(fp," } }");
+					continue;
+				}
+				if(e->phase == 'X')
+					fprintf(fp,"\"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f",
+							e->start - trace_origin,e->end - e->start);
+				else
+				{
+					/* an async span is a begin and an end with the same id */
+					fprintf(fp,"\"ph\": \"b\", \"id\": \"0x%lx\", \"ts\": %.3f",
+							e->id,e->start - trace_origin);
+					fprintf(fp," },\n{ \"pid\": %ld, \"tid\": %ld, \"cat\": \"%s\", \"name\": \"%s\", ",
+							pid,b->tid,e->cat,e->name);
+					fprintf(fp,"\"ph\": \"e\", \"id\": \"0x%lx\", \"ts\": %.3f",
+							e->id,e->end - trace_origin);
+				}
+				if(e->detail[0])
+				{
+					fprintf(fp,", \"args\": { \"detail\": ");
+					write_string(fp,e->detail);
+					fprintf(fp," }");
+				}
+				fprintf(fp," }");
+			}
+		}
+	}
+	fprintf(fp,"\n] }\n");
+	fclose(fp);
+}
+
+/*
+	The calling thread's buffer, made and listed on first use
+*/
+static struct trace_buffer *thread_buffer(void)
+{
+	struct trace_buffer *b;
+
+	if(local)
+		return(local);
+	b = (struct trace_buffer *)calloc(1,sizeof(struct trace_buffer));
+	if(b == NULL)
+		return(NULL);
+	b->tid = (long)syscall(SYS_gettid);
+	b->next = atomic_load(&buffers);
+	while(!atomic_compare_exchange_weak(&buffers,&b->next,b))
+		;
+	local = b;
+	return(b);
+}
+
+/*
+	Write `text` as a JSON string
+*/
+static void write_string(FILE *fp, const char *text)
+{
+	putc('"',fp);
+	for(;*text;text++)
+	{
+		if(*text == '"' || *text == '\\')
+			fprintf(fp,"\\%c",*text);
+		else if((unsigned char)*text < 0x20)
+			fprintf(fp,"\\u%04x",(unsigned char)*text);
+		else
+			putc(*text,fp);
+	}
+	putc('"',fp);
+}
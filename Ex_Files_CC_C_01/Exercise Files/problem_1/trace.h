@@ -0,0 +1,51 @@
+/*
+	trace
+	Records what each thread did and when, and writes it out as Chrome
+	trace_event JSON for chrome://tracing or https://ui.perfetto.dev.
+
+	Each thread appends to a buffer of its own, so recording takes no
+	lock; a thread's buffer is added to a shared list with one
+	compare-and-swap the first time it records anything. The file is
+	written by trace_close(), which trace_open() also registers with
+	atexit(). Until trace_open() is called nothing is recorded and each
+	call is a test of one flag.
+
+	Spans are complete events: take trace_now() at the start and pass
+	it to trace_span() at the end, so spans on a thread must nest. Work
+	that overlaps on one thread, such as the transfers curl runs side by
+	side, goes through trace_async() and gets a row of its own.
+	`name` and `cat` must be string constants; `detail` is copied.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+extern int trace_enabled;
+
+int trace_open(const char *path);
+void trace_close(void);
+double trace_clock(void);
+void trace_record(char phase, const char *cat, const char *name, double start, double end,
+		unsigned long id, const char *detail);
+void trace_thread_name(const char *name);
+
+/* microseconds on the monotonic clock, 0 while tracing is off */
+static inline double trace_now(void)
+{
+	return(trace_enabled ? trace_clock() : 0);
+}
+
+static inline void trace_span(const char *cat, const char *name, double start, const char *detail)
+{
+	if(trace_enabled)
+		trace_record('X',cat,name,start,trace_clock(),0,detail);
+}
+
+static inline void trace_async(const char *cat, const char *name, unsigned long id,
+		double start, const char *detail)
+{
+	if(trace_enabled)
+		trace_record('b',cat,name,start,trace_clock(),id,detail);
+}
+
+#endif
@@ -0,0 +1,142 @@
+/*
+	trend
+	See trend.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "trend.h"
+
+void trend_init(struct trend *tr, int k)
+{
+	memset(tr,0,sizeof(*tr));
+	tr->k = k;
+}
+
+/*
+	Take in the values `v` at time `t`
+*/
+void trend_add(struct trend *tr, double t, const float *v)
+{
+	double dt;
+	int c;
+
+	tr->n++;
+	dt = t - tr->mean_t;
+	tr->mean_t += dt / tr->n;
+	tr->m2_t += dt * (t - tr->mean_t);
+	for(c=0;c<tr->k;c++)
+	{
+		tr->mean_v[c] += (v[c] - tr->mean_v[c]) / tr->n;
+		/* the time before the update, the value after, as comoment.c */
+		tr->c_tv[c] += dt * (v[c] - tr->mean_v[c]);
+	}
+}
+
+/*
+	Add the rows of `from` to `into`
+*/
+void trend_merge(struct trend *into, const struct trend *from)
+{
+	double dt,share,weight;
+	long n;
+	int c;
+
+	if(from->n == 0)
+		return;
+	n = into->n + from->n;
+	share = (double)from->n / n;
+	weight = (double)into->n * share;
+	dt = from->mean_t - into->mean_t;
+	into->m2_t += from->m2_t + dt * dt * weight;
+	for(c=0;c<into->k;c++)
+	{
+		into->c_tv[c] += from->c_tv[c] + dt * (from->mean_v[c] - into->mean_v[c]) * weight;
+		into->mean_v[c] += (from->mean_v[c] - into->mean_v[c]) * share;
+	}
+	into->mean_t += dt * share;
+	into->n = n;
+}
+
+/*
+	Value `c`'s change per second, NaN unless the rows span some time
+*/
+double trend_slope(const struct trend *tr, int c)
+{
+	if(tr->n < 2 || tr->m2_t <= 0)
+		return(NAN);
+	return(tr->c_tv[c] / tr->m2_t);
+}
+
+void trend_series_init(struct trend_series *s, int k, long bucket)
+{
+	memset(s,0,sizeof(*s));
+	s->k = k;
+	s->bucket = bucket;
+	trend_init(&s->whole,k);
+}
+
+/*
+	Take in the values `v` at time `t`
+	Returns 0, or -1 if a new period can't be allocated.
+*/
+int trend_series_add(struct trend_series *s, long t, const float *v)
+{
+	struct trend *period;
+	long *start,first;
+
+	if(s->whole.n == 0)
+		s->origin = t;
+	trend_add(&s->whole,(double)(t - s->origin),v);
+	if(s->bucket <= 0)
+		return(0);
+
+	/* the start of the period holding `t`, rounding down before 1970 too */
+	first = t - ((t % s->bucket) + s->bucket) % s->bucket;
+	if(s->periods == 0 || s->start[s->periods-1] != first)
+	{
+		if(s->periods == s->capacity)
+		{
+			s->capacity = s->capacity ? s->capacity*2 : 64;
+			period = (struct trend *)realloc(s->period,s->capacity*sizeof(struct trend));
+			if(period == NULL)
+				return(-1);
+			s->period = period;
+			start = (long *)realloc(s->start,s->capacity*sizeof(long));
+			if(start == NULL)
+				return(-1);
+			s->start = start;
+		}
+		trend_init(&s->period[s->periods],s->k);
+		s->start[s->periods] = first;
+		s->periods++;
+	}
+	trend_add(&s->period[s->periods-1],(double)(t - s->origin),v);
+	return(0);
+}
+
+/*
+	The trend over the `window` seconds up to the end of period `p`:
+	the merge of that period and those before it that started in the
+	window
+*/
+void trend_series_window(const struct trend_series *s, int p, long window, struct trend *tr)
+{
+	long from;
+	int q;
+
+	trend_init(tr,s->k);
+	from = s->start[p] + s->bucket - window;
+	for(q=p;q>=0 && s->start[q] >= from;q--)
+		trend_merge(tr,&s->period[q]);
+}
+
+void trend_series_free(struct trend_series *s)
+{
+	free(s->period);
+	free(s->start);
+	s->period = NULL;
+	s->start = NULL;
+	s->periods = s->capacity = 0;
+}
@@ -0,0 +1,55 @@
+/*
+	trend
+	Least-squares slopes of several values against time, built up one
+	row at a time.
+
+	A struct trend keeps the count, the means of the time and of each
+	value, the sum of squared time deviations and the sum of products
+	of time and value deviations, updated Welford's way; the slope of a
+	value is the second sum over the first. Two of them merge by the
+	same rule as comoment.h, so the trend over any run of periods is
+	the merge of the periods' own, with no second pass over the rows.
+
+	A struct trend_series splits the rows into periods of `bucket`
+	seconds, aligned to the Unix epoch, and keeps each period's trend as
+	well as the trend of the whole. With the stamps taken as UTC (see
+	timestamp.h), a bucket that divides a day also lines the periods up
+	with the stamps' midnight; any other doesn't. Rows are expected in
+	time order: a row from an earlier period starts a new one.
+*/
+
+#ifndef TREND_H
+#define TREND_H
+
+#define TREND_MAX 8					/* values per row */
+
+struct trend {
+	int k;
+	long n;
+	double mean_t;
+	double m2_t;					/* sum of squared time deviations */
+	double mean_v[TREND_MAX];
+	double c_tv[TREND_MAX];			/* sums of time x value deviations */
+};
+
+struct trend_series {
+	int k;
+	long bucket;					/* seconds per period, 0 for none */
+	long origin;					/* first time seen; times are kept from here */
+	struct trend whole;
+	struct trend *period;
+	long *start;					/* of each period */
+	int periods;
+	int capacity;
+};
+
+void trend_init(struct trend *tr, int k);
+void trend_add(struct trend *tr, double t, const float *v);
+void trend_merge(struct trend *into, const struct trend *from);
+double trend_slope(const struct trend *tr, int c);
+void trend_series_init(struct trend_series *s, int k, long bucket);
+int trend_series_add(struct trend_series *s, long t, const float *v);
+void trend_series_window(const struct trend_series *s, int p, long window, struct trend *tr);
+void trend_series_free(struct trend_series *s);
+
+#endif
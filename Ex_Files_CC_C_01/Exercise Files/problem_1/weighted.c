@@ -0,0 +1,130 @@
+/*
+	weighted
+	See weighted.h
+*/
+
+#include <string.h>
+#include "weighted.h"
+
+static void swap_pair(float *v, float *w, int a, int b);
+
+void time_weight_init(struct time_weight *tw, int k)
+{
+	memset(tw,0,sizeof(*tw));
+	tw->k = k;
+}
+
+/*
+	Take in the next row, with time `t` in seconds
+	Returns the seconds since the previous row, half of which belongs to
+	each of the two; 0 for the first row or one out of order.
+*/
+double time_weight_add(struct time_weight *tw, long t, const float *v)
+{
+	double interval;
+	int i;
+
+	interval = 0;
+	if(tw->rows && t > tw->last_t)
+		interval = t - tw->last_t;
+	for(i=0;i<tw->k;i++)
+	{
+		tw->area[i] += interval * (tw->last[i] + v[i]) / 2;
+		tw->sum[i] += v[i];
+		tw->last[i] = v[i];
+	}
+	tw->span += interval;
+	tw->last_t = t;
+	tw->rows++;
+	return(interval);
+}
+
+/*
+	The time-weighted mean of value `i`; the plain mean when the rows
+	all share one time
+*/
+double time_weight_mean(const struct time_weight *tw, int i)
+{
+	if(tw->span > 0)
+		return(tw->area[i] / tw->span);
+	return(tw->rows ? tw->sum[i] / tw->rows : 0);
+}
+
+/*
+	The weighted median of v[0..c), value v[x] having weight w[x]
+	Both arrays are reordered together. When the weights add up to
+	nothing every value is given the same weight instead, which
+	overwrites `w`.
+*/
+float weighted_median(float *v, float *w, int c)
+{
+	double total,half,below,left,equal;
+	int lo,hi,i,j,mid,x;
+	float pivot;
+
+	total = 0;
+	for(x=0;x<c;x++)
+		total += *(w+x);
+	if(total <= 0)
+	{
+		for(x=0;x<c;x++)
+			*(w+x) = 1;
+		total = c;
+	}
+	half = total / 2;
+	below = 0;					/* weight of v[0..lo), all <= v[lo..hi] */
+	lo = 0;
+	hi = c - 1;
+	while(lo < hi)
+	{
+		/* order v[lo], v[mid], v[hi] and take the middle one as pivot */
+		mid = lo + (hi - lo)/2;
+		if(*(v+mid) < *(v+lo)) swap_pair(v,w,mid,lo);
+		if(*(v+hi) < *(v+lo)) swap_pair(v,w,hi,lo);
+		if(*(v+hi) < *(v+mid)) swap_pair(v,w,hi,mid);
+		pivot = *(v+mid);
+
+		/* Hoare partition, as select_kth() */
+		i = lo;
+		j = hi;
+		while(i <= j)
+		{
+			while(*(v+i) < pivot)
+				i++;
+			while(*(v+j) > pivot)
+				j--;
+			if(i <= j)
+			{
+				swap_pair(v,w,i,j);
+				i++;
+				j--;
+			}
+		}
+
+		/* v[lo..j] <= pivot, v[j+1..i-1] == pivot, v[i..hi] >= pivot */
+		left = 0;
+		for(x=lo;x<=j;x++)
+			left += *(w+x);
+		if(below + left >= half)
+		{
+			hi = j;
+			continue;
+		}
+		equal = 0;
+		for(x=j+1;x<i;x++)
+			equal += *(w+x);
+		if(below + left + equal >= half)
+			return(pivot);
+		below += left + equal;
+		lo = i;
+	}
+	return(*(v+lo));
+}
+
+static void swap_pair(float *v, float *w, int a, int b)
+{
+	float t;
+
+	t = *(v+a); *(v+a) = *(v+b); *(v+b) = t;
+	t = *(w+a); *(w+a) = *(w+b); *(w+b) = t;
+}
@@ -0,0 +1,42 @@
+/*
+	weighted
+	Time-weighted means and medians, for rows that don't come at a
+	steady rate.
+
+	Each row stands for half the interval back to the row before it and
+	half the interval on to the row after, so a row on its own in a
+	sparse stretch counts for more than one of a quick burst, and a
+	value read either side of a gap covers half of it. The weighted mean
+	is then the area under the line joining the rows (the trapezoid
+	rule) over the time they span: a struct time_weight keeps the two
+	sums and the previous row, and takes the rows one at a time.
+
+	The weighted median is the smallest value with at least half the
+	total weight at or below it. weighted_median() finds it with the
+	same partitioning as an ordinary quickselect, moving the weights
+	with the values and keeping a running total of the weight known to
+	lie below; only the part holding the halfway point is partitioned
+	again, so it takes expected linear time.
+*/
+
+#ifndef WEIGHTED_H
+#define WEIGHTED_H
+
+#define TIME_WEIGHT_MAX 8				/* values per row */
+
+struct time_weight {
+	int k;
+	long rows;
+	long last_t;						/* the previous row's */
+	float last[TIME_WEIGHT_MAX];
+	double area[TIME_WEIGHT_MAX];		/* value x seconds */
+	double span;						/* seconds */
+	double sum[TIME_WEIGHT_MAX];		/* plain sums, for when no time passes */
+};
+
+void time_weight_init(struct time_weight *tw, int k);
+double time_weight_add(struct time_weight *tw, long t, const float *v);
+double time_weight_mean(const struct time_weight *tw, int i);
+float weighted_median(float *v, float *w, int c);
+
+#endif